@@ -0,0 +1,278 @@
+//============================================================================
+// Name        : SortBench.cpp
+// Description : Micro benchmarks for the vsort kernels (partition strategies, key kinds, normalized keys)
+//============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "CSVparser.hpp"
+#include "Instrumentation.hpp"
+#include "SortKernels.hpp"
+#include "SortKeys.hpp"
+
+using namespace std;
+
+// Best-of-N timing keeps one noisy run from skewing the comparison
+const int kRepetitions = 5;
+
+// A record shaped like Bid so the benchmark moves realistic amounts of data
+struct Record {
+    string bidId;
+    string title;
+    string fund;
+    double amount;
+};
+
+struct RecordTitle {
+    const string &operator()(const Record &r) const { return r.title; }
+};
+
+struct RecordAmount {
+    double operator()(const Record &r) const { return r.amount; }
+};
+
+struct EncodeTitle {
+    vsort::NormalizedKey operator()(const Record &r) const { return vsort::encodeString(r.title); }
+};
+
+struct EncodeAmount {
+    vsort::NormalizedKey operator()(const Record &r) const { return vsort::encodeDouble(r.amount); }
+};
+
+// First 16 title bytes as a memcmp key (the kernels' FixedPrefix path) ...
+struct PrefixTitle {
+    vsort::FixedPrefix<16> operator()(const Record &r) const {
+        vsort::FixedPrefix<16> key;
+        memset(key.bytes, 0, sizeof(key.bytes));
+        memcpy(key.bytes, r.title.data(), min<size_t>(r.title.size(), sizeof(key.bytes)));
+        return key;
+    }
+};
+
+// ... and the plain-string order it has to reproduce
+struct TitleHead {
+    string operator()(const Record &r) const { return r.title.substr(0, 16); }
+};
+
+// Title with ASCII letters lower-cased: the reference for encodeFolded
+struct FoldedTitle {
+    string operator()(const Record &r) const {
+        string folded = r.title;
+        for (char &ch: folded) {
+            if (ch >= 'A' && ch <= 'Z') {
+                ch = static_cast<char>(ch - 'A' + 'a');
+            }
+        }
+        return folded;
+    }
+};
+
+struct EncodeFolded {
+    vsort::NormalizedKey operator()(const Record &r) const { return vsort::encodeFolded(r.title); }
+};
+
+// (fund, title): the reference for encodeCompound
+struct FundTitle {
+    tuple<const string &, const string &> operator()(const Record &r) const { return tie(r.fund, r.title); }
+};
+
+struct EncodeFundTitle {
+    vsort::NormalizedKey operator()(const Record &r) const { return vsort::encodeCompound(r.fund, r.title); }
+};
+
+/**
+ * Time one sort variant on fresh copies of the input and print a table row
+ *
+ * @param label dataset name for the table
+ * @param variant engine/partition/key description for the table
+ * @param input records to sort (left untouched)
+ * @param proj key projection used to verify the result
+ * @param sortFn sorts a vector<Record> in place
+ */
+template<typename Proj, typename SortFn>
+void runCase(const string &label, const string &variant, const vector<Record> &input, Proj proj, SortFn sortFn) {
+    double best = 1e300;
+    uint64_t comparisons = 0, swaps = 0;
+
+    for (int rep = 0; rep < kRepetitions; rep++) {
+        vector<Record> work = input;
+        instr::reset();
+        auto start = chrono::steady_clock::now();
+        sortFn(work);
+        chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+
+        if (!is_sorted(work.begin(), work.end(),
+                       [&proj](const Record &a, const Record &b) { return proj(a) < proj(b); })) {
+            cerr << "!! " << label << " / " << variant << " did not sort" << endl;
+        }
+        best = min(best, took.count());
+        comparisons = instr::count(instr::eCOMPARISONS);
+        swaps = instr::count(instr::eSWAPS);
+    }
+
+    cout << left << setw(22) << label << setw(21) << variant
+         << right << setw(10) << input.size()
+         << setw(12) << fixed << setprecision(2) << best
+         << setw(14) << comparisons << setw(12) << swaps << endl;
+}
+
+/**
+ * Both partition strategies on the plain key, then block partition on
+ * normalized keys (encode builds the 16-byte prefix)
+ */
+template<typename Proj, typename Encode>
+void compareStrategies(const string &label, const vector<Record> &input, Proj proj, Encode encode) {
+    const vsort::PartitionStrategy strategies[] = { vsort::eHOARE, vsort::eBLOCK };
+    for (vsort::PartitionStrategy strategy: strategies) {
+        runCase(label, vsort::partitionName(strategy), input, proj, [&](vector<Record> &v) {
+            vsort::quickSort(v.begin(), v.end(), proj, vsort::Less(), strategy);
+        });
+    }
+    runCase(label, "block+normalized", input, proj, [&](vector<Record> &v) {
+        vsort::sortNormalized(v.begin(), v.end(), encode, proj, vsort::QuickSorter(vsort::eBLOCK));
+    });
+    runCase(label, "adaptive", input, proj, [&](vector<Record> &v) {
+        vsort::adaptiveSort(v.begin(), v.end(), proj);
+    });
+    runCase(label, "adaptive+normalized", input, proj, [&](vector<Record> &v) {
+        vsort::sortNormalized(v.begin(), v.end(), encode, proj, vsort::AdaptiveSorter());
+    });
+}
+
+/**
+ * Key kinds beyond the plain title: FixedPrefix keys (one memcmp per
+ * compare), case-folded and compound (fund, title) normalized keys, each
+ * checked against std::string order of the same key
+ */
+void compareKeyKinds(const string &label, const vector<Record> &input) {
+    runCase(label, "block+prefix16", input, TitleHead(), [](vector<Record> &v) {
+        vsort::quickSort(v.begin(), v.end(), PrefixTitle(), vsort::Less(), vsort::eBLOCK);
+    });
+    runCase(label, "folded+normalized", input, FoldedTitle(), [](vector<Record> &v) {
+        vsort::sortNormalized(v.begin(), v.end(), EncodeFolded(), FoldedTitle(), vsort::QuickSorter(vsort::eBLOCK));
+    });
+    runCase(label, "fund,title+normalized", input, FundTitle(), [](vector<Record> &v) {
+        vsort::sortNormalized(v.begin(), v.end(), EncodeFundTitle(), FundTitle(), vsort::QuickSorter(vsort::eBLOCK));
+    });
+}
+
+/**
+ * csv::Parser::sortBy (Row pointers through the same kernels), checked
+ * against plain string order of the column, ascending and descending
+ */
+void compareSortBy(const string &csvPath) {
+    const bool descendings[] = { false, true };
+    for (bool descending: descendings) {
+        double best = 1e300;
+        uint64_t comparisons = 0, swaps = 0;
+        unsigned int rows = 0;
+        for (int rep = 0; rep < kRepetitions; rep++) {
+            csv::Parser file(csvPath);
+            rows = file.rowCount();
+            instr::reset();
+            auto start = chrono::steady_clock::now();
+            file.sortBy(0, descending);
+            chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+
+            for (unsigned int i = 1; i < rows; i++) {
+                const string &a = file[i - 1].field(0), &b = file[i].field(0);
+                if (descending ? a < b : b < a) {
+                    cerr << "!! csv rows / sortBy did not sort" << endl;
+                    break;
+                }
+            }
+            best = min(best, took.count());
+            comparisons = instr::count(instr::eCOMPARISONS);
+            swaps = instr::count(instr::eSWAPS);
+        }
+        cout << left << setw(22) << "csv rows" << setw(21) << (descending ? "sortBy title desc" : "sortBy title")
+             << right << setw(10) << rows
+             << setw(12) << fixed << setprecision(2) << best
+             << setw(14) << comparisons << setw(12) << swaps << endl;
+    }
+}
+
+/**
+ * Load the bid records the same way the main program does
+ */
+vector<Record> loadRecords(const string &csvPath) {
+    vector<Record> records;
+    csv::Parser file(csvPath);
+    records.reserve(file.rowCount());
+    for (unsigned int i = 0; i < file.rowCount(); i++) {
+        Record r;
+        r.title = file[i].field(0);
+        r.bidId = file[i].field(1);
+        r.fund = file[i].field(8);
+        string amount = file[i].field(4);
+        amount.erase(remove_if(amount.begin(), amount.end(),
+                               [](char ch) { return ch == '$' || ch == ',' || ch == ' '; }), amount.end());
+        r.amount = atof(amount.c_str());
+        records.push_back(r);
+    }
+    return records;
+}
+
+vector<Record> randomRecords(size_t n, uint32_t seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> letter('a', 'z');
+    uniform_real_distribution<double> amount(0.0, 10000.0);
+
+    vector<Record> records(n);
+    for (auto &r: records) {
+        r.title.resize(12);
+        for (auto &ch: r.title) {
+            ch = static_cast<char>(letter(rng));
+        }
+        r.amount = amount(rng);
+    }
+    return records;
+}
+
+int main(int argc, char *argv[]) {
+    string csvPath = argc > 1 ? argv[1] : "data/eBid_Monthly_Sales.csv";
+    size_t randomSize = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 1000000;
+
+    if (!instr::enabled()) {
+        cout << "(instrumentation compiled out: comparison/swap columns read 0)" << endl;
+    }
+    cout << left << setw(22) << "Dataset" << setw(21) << "Variant"
+         << right << setw(10) << "Rows" << setw(12) << "Best (ms)"
+         << setw(14) << "Comparisons" << setw(12) << "Swaps" << endl;
+
+    try {
+        vector<Record> bids = loadRecords(csvPath);
+        compareStrategies("csv titles", bids, RecordTitle(), EncodeTitle());
+        compareStrategies("csv amounts", bids, RecordAmount(), EncodeAmount());
+        compareKeyKinds("csv titles", bids);
+        compareSortBy(csvPath);
+    } catch (csv::Error &e) {
+        cerr << e.what() << endl;
+    }
+
+    vector<Record> random = randomRecords(randomSize, 42);
+    compareStrategies("random titles", random, RecordTitle(), EncodeTitle());
+    compareStrategies("random amounts", random, RecordAmount(), EncodeAmount());
+    compareKeyKinds("random titles", random);
+
+    // presorted shapes: already sorted, reversed, and sorted plus 1% appended
+    vector<Record> sorted = random;
+    vsort::quickSort(sorted.begin(), sorted.end(), RecordTitle(), vsort::Less(), vsort::eBLOCK);
+    compareStrategies("sorted titles", sorted, RecordTitle(), EncodeTitle());
+    vector<Record> reversed(sorted.rbegin(), sorted.rend());
+    compareStrategies("reversed titles", reversed, RecordTitle(), EncodeTitle());
+    vector<Record> appended = sorted;
+    vector<Record> extra = randomRecords(randomSize / 100, 7);
+    appended.insert(appended.end(), extra.begin(), extra.end());
+    compareStrategies("sorted + 1% appended", appended, RecordTitle(), EncodeTitle());
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "AsyncReader.hpp"
+#include "Instrumentation.hpp"
+#include "MemoryBudget.hpp"
+
+namespace csv {
+
+  namespace {
+    // O_DIRECT wants buffer addresses and sizes aligned to the block size
+    const std::size_t kAlignment = 4096;
+
+    std::string errnoText(void)
+    {
+        return std::string(std::strerror(errno));
+    }
+  }
+
+  /*
+  ** FILE SOURCE
+  */
+
+  FileSource::FileSource(const std::string &path, const ReadOptions &options, std::size_t offset)
+    : _path(path), _fd(-1), _direct(false)
+  {
+      int flags = O_RDONLY;
+#ifdef O_CLOEXEC
+      flags |= O_CLOEXEC;
+#endif
+#ifdef O_DIRECT
+      if (options.directIO)
+      {
+          // some filesystems (tmpfs, many FUSE mounts) refuse O_DIRECT
+          _fd = ::open(path.c_str(), flags | O_DIRECT);
+          _direct = _fd >= 0;
+      }
+#endif
+      if (_fd < 0)
+          _fd = ::open(path.c_str(), flags);
+      if (_fd < 0)
+          throw Error(std::string("Failed to open ").append(path));
+
+      if (offset > 0)
+      {
+          struct stat st;
+          if (fstat(_fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < offset ||
+              lseek(_fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+          {
+              ::close(_fd);
+              throw Error(path + " is shorter than the last parsed offset (truncated or replaced)");
+          }
+      }
+
+#ifdef F_NOCACHE
+      // macOS has no O_DIRECT; F_NOCACHE is the closest equivalent
+      if (options.directIO && fcntl(_fd, F_NOCACHE, 1) == 0)
+          _direct = true;
+#endif
+#if defined(POSIX_FADV_SEQUENTIAL)
+      posix_fadvise(_fd, static_cast<off_t>(offset), 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#if defined(__linux__)
+      // start pulling the first buffers in before the reader asks for them
+      if (!_direct)
+          readahead(_fd, static_cast<off64_t>(offset), options.bufferSize * 2);
+#elif defined(F_RDAHEAD)
+      fcntl(_fd, F_RDAHEAD, 1);
+#endif
+  }
+
+  FileSource::~FileSource(void)
+  {
+      if (_fd >= 0)
+          ::close(_fd);
+  }
+
+  std::size_t FileSource::read(char *buffer, std::size_t size)
+  {
+      VS_SCOPE(eIO);
+      std::size_t total = 0;
+
+      // keep reading until the buffer is full or the file ends so the
+      // consumer always gets large chunks
+      while (total < size)
+      {
+          ssize_t n = ::read(_fd, buffer + total, size - total);
+          if (n < 0)
+          {
+              if (errno == EINTR)
+                  continue;
+#ifdef O_DIRECT
+              if (errno == EINVAL && _direct)
+              {
+                  // unaligned tail or unsupported device: drop O_DIRECT and retry
+                  fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+                  _direct = false;
+                  continue;
+              }
+#endif
+              throw Error(std::string("Failed to read ").append(_path).append(": ").append(errnoText()));
+          }
+          if (n == 0)
+              break;
+          total += static_cast<std::size_t>(n);
+      }
+      VS_COUNT(eBYTES_READ, total);
+      return total;
+  }
+
+  /*
+  ** FD SOURCE
+  */
+
+  FdSource::FdSource(int fd, const std::string &name)
+    : _name(name), _fd(fd) {}
+
+  std::size_t FdSource::read(char *buffer, std::size_t size)
+  {
+      VS_SCOPE(eIO);
+      std::size_t total = 0;
+
+      // a pipe hands out at most a pipe buffer per read: keep going so the
+      // parser still gets large chunks
+      while (total < size)
+      {
+          ssize_t n = ::read(_fd, buffer + total, size - total);
+          if (n < 0)
+          {
+              if (errno == EINTR)
+                  continue;
+              throw Error(std::string("Failed to read ").append(_name).append(": ").append(errnoText()));
+          }
+          if (n == 0)
+              break;
+          total += static_cast<std::size_t>(n);
+      }
+      VS_COUNT(eBYTES_READ, total);
+      return total;
+  }
+
+  /*
+  ** ASYNC READER
+  */
+
+  AsyncReader::AsyncReader(std::unique_ptr<ByteSource> source, const ReadOptions &options)
+    : _source(std::move(source)), _readIndex(0), _holding(false), _stop(false)
+  {
+      // round up to the alignment so O_DIRECT reads stay legal
+      _bufferSize = (options.bufferSize + kAlignment - 1) / kAlignment * kAlignment;
+      if (_bufferSize == 0)
+          _bufferSize = kAlignment;
+
+      std::size_t count = options.buffers < 2 ? 2 : options.buffers;
+      for (std::size_t i = 0; i < count; i++)
+      {
+          Buffer b;
+          void *mem = 0;
+          if (posix_memalign(&mem, kAlignment, _bufferSize) != 0)
+          {
+              for (std::size_t j = 0; j < _buffers.size(); j++)
+                  std::free(_buffers[j].data);
+              throw Error("can't allocate read buffers");
+          }
+          b.data = static_cast<char *>(mem);
+          b.size = 0;
+          b.full = false;
+          _buffers.push_back(b);
+      }
+      VS_COUNT(eALLOCATIONS, count);
+      mem::charge(mem::eTEXT, count * _bufferSize);
+
+      _thread = std::thread(&AsyncReader::run, this);
+  }
+
+  AsyncReader::~AsyncReader(void)
+  {
+      {
+          std::lock_guard<std::mutex> guard(_lock);
+          _stop = true;
+      }
+      _cond.notify_all();
+      if (_thread.joinable())
+          _thread.join();
+      for (std::size_t i = 0; i < _buffers.size(); i++)
+          std::free(_buffers[i].data);
+      mem::release(mem::eTEXT, _buffers.size() * _bufferSize);
+  }
+
+  void AsyncReader::run(void)
+  {
+      std::size_t index = 0;
+      try
+      {
+          while (true)
+          {
+              {
+                  std::unique_lock<std::mutex> guard(_lock);
+                  _cond.wait(guard, [&] { return _stop || !_buffers[index].full; });
+                  if (_stop)
+                      return;
+              }
+
+              // the buffer is ours until it is marked full
+              std::size_t n = _source->read(_buffers[index].data, _bufferSize);
+
+              {
+                  std::lock_guard<std::mutex> guard(_lock);
+                  _buffers[index].size = n;
+                  _buffers[index].full = true;
+              }
+              _cond.notify_all();
+
+              if (n == 0)
+                  return; // an empty full buffer marks end of input
+              index = (index + 1) % _buffers.size();
+          }
+      }
+      catch (...)
+      {
+          std::lock_guard<std::mutex> guard(_lock);
+          _error = std::current_exception();
+          _cond.notify_all();
+      }
+  }
+
+  bool AsyncReader::next(const char *&data, std::size_t &size)
+  {
+      std::unique_lock<std::mutex> guard(_lock);
+
+      if (_holding)
+      {
+          // give the buffer the caller was using back to the reader thread
+          _buffers[_readIndex].full = false;
+          _readIndex = (_readIndex + 1) % _buffers.size();
+          _holding = false;
+          _cond.notify_all();
+      }
+
+      {
+          VS_SCOPE(eIO_WAIT);
+          _cond.wait(guard, [&] { return _buffers[_readIndex].full || _error; });
+      }
+      if (!_buffers[_readIndex].full)
+          std::rethrow_exception(_error);
+
+      Buffer &b = _buffers[_readIndex];
+      if (b.size == 0)
+          return false;
+
+      _holding = true;
+      data = b.data;
+      size = b.size;
+      return true;
+  }
+}
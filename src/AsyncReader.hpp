@@ -0,0 +1,106 @@
+#ifndef     _ASYNCREADER_HPP_
+# define    _ASYNCREADER_HPP_
+
+# include <condition_variable>
+# include <cstddef>
+# include <exception>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+# include "CSVparser.hpp"
+
+namespace csv
+{
+    /*
+    ** Anything the reader thread can pull bytes from
+    */
+    class ByteSource
+    {
+      public:
+        virtual ~ByteSource(void) {}
+        // Fill up to size bytes; returns 0 only at end of input. Throws Error.
+        virtual std::size_t read(char *buffer, std::size_t size) = 0;
+    };
+
+    /*
+    ** File descriptor source with sequential read-ahead hints
+    */
+    class FileSource : public ByteSource
+    {
+      public:
+        // offset > 0 starts reading there (live tail); a file now shorter
+        // than offset was truncated or replaced and throws
+        FileSource(const std::string &path, const ReadOptions &options, std::size_t offset = 0);
+        ~FileSource(void);
+
+        std::size_t read(char *buffer, std::size_t size);
+
+      private:
+        FileSource(const FileSource &);
+        FileSource &operator=(const FileSource &);
+
+        const std::string _path;
+        int _fd;
+        bool _direct;
+    };
+
+    /*
+    ** An already open descriptor (stdin, a pipe): no seeking, no hints
+    */
+    class FdSource : public ByteSource
+    {
+      public:
+        // fd is borrowed, not closed; name is what errors call it
+        FdSource(int fd, const std::string &name);
+
+        std::size_t read(char *buffer, std::size_t size);
+
+      private:
+        const std::string _name;
+        const int _fd;
+    };
+
+    /*
+    ** Double (or N-) buffered reader: a background thread fills large
+    ** page-aligned buffers from a ByteSource while the caller consumes the
+    ** previous one, so parsing and I/O overlap.
+    */
+    class AsyncReader
+    {
+      public:
+        AsyncReader(std::unique_ptr<ByteSource> source, const ReadOptions &options);
+        ~AsyncReader(void);
+
+        // Hand out the next filled buffer (the previous one goes back to the
+        // reader thread). Returns false at end of input; rethrows reader errors.
+        bool next(const char *&data, std::size_t &size);
+
+      private:
+        AsyncReader(const AsyncReader &);
+        AsyncReader &operator=(const AsyncReader &);
+
+        struct Buffer
+        {
+            char *data;
+            std::size_t size;
+            bool full;
+        };
+
+        void run(void);
+
+        std::unique_ptr<ByteSource> _source;
+        std::size_t _bufferSize;
+        std::vector<Buffer> _buffers;
+        std::size_t _readIndex;
+        bool _holding;
+        bool _stop;
+        std::exception_ptr _error;
+        std::mutex _lock;
+        std::condition_variable _cond;
+        std::thread _thread;
+    };
+}
+
+#endif /*!_ASYNCREADER_HPP_*/
@@ -0,0 +1,35 @@
+#ifndef     _BID_HPP_
+# define    _BID_HPP_
+
+# include <cstddef>
+# include <string>
+# include <vector>
+
+// define a structure to hold bid information
+struct Bid {
+    std::string bidId; // unique identifiers
+    std::string title;
+    std::string fund;
+    double amount;
+
+    Bid() {
+        amount = 0.0; //initialize amount to 0.0
+    }
+};
+
+/**
+ * Convert a string like "$1,234.56" to a double after stripping ch,
+ * commas and whitespace (defined in BidLoader.cpp)
+ */
+double strToDouble(std::string str, char ch);
+
+// Heap a bid's strings hold outside its slot (defined in BidLoader.cpp)
+std::size_t bidHeapBytes(const Bid &bid);
+
+/**
+ * Heap bytes held by bids: the vector's capacity plus every field's string
+ * buffer (defined in BidLoader.cpp; what mem::eBIDS is charged)
+ */
+std::size_t bidsFootprint(const std::vector<Bid> &bids);
+
+#endif /*!_BID_HPP_*/
@@ -0,0 +1,225 @@
+#ifndef     _BIDLIST_HPP_
+# define    _BIDLIST_HPP_
+
+# include <algorithm>
+# include <cstddef>
+# include <iterator>
+# include <memory>
+# include <string>
+# include <utility>
+# include <vector>
+# include "Bid.hpp"
+# include "CSVparser.hpp"
+# include "MemoryBudget.hpp"
+
+/**
+ * The bids of one BidStore version: slices of immutable blocks shared by
+ * reference count. Copying a list copies its slice table, not the bids.
+ * An append adds a block (or rewrites the short last slice), and a sorted
+ * merge rewrites only the slices the new bids land in, so the versions
+ * before and after an edit share every bid it didn't touch. A block stays
+ * charged to mem::eBIDS for as long as any version holds a slice of it.
+ */
+class BidList {
+public:
+    // Most bids in one slice; longer blocks (and merged slices) are cut up
+    static const std::size_t kSliceBids = 4096;
+
+    BidList() : _size(0) {}
+
+    std::size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    // O(log slices); a pass over many bids is cheaper with forEach
+    const Bid &operator[](std::size_t i) const {
+        std::size_t s = std::upper_bound(_starts.begin(), _starts.end(), i) - _starts.begin() - 1;
+        const Slice &slice = _slices[s];
+        return (*slice.block)[slice.first + (i - _starts[s])];
+    }
+
+    // Call visit(bid) for bids [first, last), in order
+    template<typename Visit>
+    void forEach(std::size_t first, std::size_t last, Visit visit) const {
+        if (first >= last) {
+            return;
+        }
+        std::size_t s = std::upper_bound(_starts.begin(), _starts.end(), first) - _starts.begin() - 1;
+        std::size_t at = _slices[s].first + (first - _starts[s]);
+        for (std::size_t left = last - first; left > 0; ++s) {
+            const Slice &slice = _slices[s];
+            std::size_t stop = std::min(slice.last, at + left);
+            for (std::size_t i = at; i < stop; i++) {
+                visit((*slice.block)[i]);
+            }
+            left -= stop - at;
+            if (s + 1 < _slices.size()) {
+                at = _slices[s + 1].first;
+            }
+        }
+    }
+
+    // Replace the list with bids, taken over without a copy (loads)
+    void assign(std::vector<Bid> &&bids) {
+        _slices.clear();
+        _starts.clear();
+        _size = 0;
+        append(std::move(bids));
+    }
+
+    // Add bids at the end. They become a new block; only a short last
+    // slice (appends of a few bids at a time) is copied to join them.
+    void append(std::vector<Bid> &&bids) {
+        if (bids.empty()) {
+            return;
+        }
+        if (!_slices.empty() && lastSliceSize() + bids.size() <= kSliceBids) {
+            const Slice &last = _slices.back();
+            std::vector<Bid> joined;
+            joined.reserve(lastSliceSize() + bids.size());
+            joined.insert(joined.end(), last.block->begin() + last.first, last.block->begin() + last.last);
+            joined.insert(joined.end(), std::make_move_iterator(bids.begin()), std::make_move_iterator(bids.end()));
+            _size -= lastSliceSize();
+            _slices.pop_back();
+            _starts.pop_back();
+            bids.swap(joined);
+        }
+        addSlices(makeBlock(std::move(bids)));
+    }
+
+    /**
+     * Merge bids into the list; both must already be in less order. Equal
+     * keys keep the bids already here first. Slices that no new bid lands
+     * in are shared as they are; the others are merged into new blocks.
+     */
+    template<typename Less>
+    void mergeSorted(std::vector<Bid> &&bids, Less less) {
+        if (_slices.empty() || bids.empty()) {
+            append(std::move(bids));
+            return;
+        }
+        std::vector<Slice> slices;
+        slices.swap(_slices);
+        _starts.clear();
+        _size = 0;
+        auto next = bids.begin();
+        for (std::size_t s = 0; s < slices.size(); s++) {
+            const Slice &slice = slices[s];
+            // a bid before the next slice's first one (and not equal to it) lands here
+            auto stop = s + 1 < slices.size()
+                        ? std::lower_bound(next, bids.end(), (*slices[s + 1].block)[slices[s + 1].first], less)
+                        : bids.end();
+            if (stop == next) {
+                addSlice(slice);
+                continue;
+            }
+            std::vector<Bid> merged;
+            merged.reserve(slice.last - slice.first + (stop - next));
+            std::merge(slice.block->begin() + slice.first, slice.block->begin() + slice.last,
+                       std::make_move_iterator(next), std::make_move_iterator(stop),
+                       std::back_inserter(merged), less);
+            addSlices(makeBlock(std::move(merged)));
+            next = stop;
+        }
+    }
+
+    /**
+     * Reorder the bids (sorts): edit gets all of them in one vector. The
+     * blocks are shared with other versions, so that vector is a copy,
+     * charged to mem::eBIDS until it becomes this list's new block.
+     *
+     * @throws csv::Error before copying anything when the copy doesn't fit
+     *         the memory budget (the message carries the estimate)
+     */
+    template<typename Edit>
+    void rewrite(Edit edit) {
+        std::size_t bytes = copyBytes();
+        if (!mem::fits(bytes)) {
+            throw csv::Error("sorting " + std::to_string(_size) + " bids needs a copy of about " +
+                             mem::formatBytes(bytes) + ", but only " + mem::formatBytes(mem::headroom()) +
+                             " of the " + mem::formatBytes(mem::budget()) + " memory budget is free");
+        }
+        mem::Reservation copy(mem::eBIDS, bytes);
+        std::vector<Bid> all = flatten();
+        edit(all);
+        copy.resize(0);
+        assign(std::move(all));
+    }
+
+    // Every bid, copied into one vector
+    std::vector<Bid> flatten() const {
+        std::vector<Bid> all;
+        all.reserve(_size);
+        forEach(0, _size, [&all](const Bid &bid) { all.push_back(bid); });
+        return all;
+    }
+
+    // What flatten() allocates (see bidsFootprint)
+    std::size_t copyBytes() const {
+        std::size_t bytes = _size * sizeof(Bid);
+        forEach(0, _size, [&bytes](const Bid &bid) { bytes += bidHeapBytes(bid); });
+        return bytes;
+    }
+
+    // Heap held by the slice table; the blocks charge themselves
+    std::size_t tableBytes() const {
+        return _slices.capacity() * sizeof(Slice) + _starts.capacity() * sizeof(std::size_t);
+    }
+
+private:
+    typedef std::shared_ptr<const std::vector<Bid> > Block;
+
+    // [first, last) of one block
+    struct Slice {
+        Block block;
+        std::size_t first;
+        std::size_t last;
+    };
+
+    // Deleter of a block: frees it and its memory charge
+    struct Release {
+        std::size_t bytes;
+
+        void operator()(const std::vector<Bid> *block) const {
+            mem::release(mem::eBIDS, bytes);
+            delete block;
+        }
+    };
+
+    static Block makeBlock(std::vector<Bid> &&bids) {
+        std::unique_ptr<std::vector<Bid> > block(new std::vector<Bid>(std::move(bids)));
+        Release release = { sizeof(std::vector<Bid>) + bidsFootprint(*block) };
+        mem::charge(mem::eBIDS, release.bytes);
+        return Block(block.release(), release);
+    }
+
+    std::size_t lastSliceSize() const {
+        return _slices.back().last - _slices.back().first;
+    }
+
+    void addSlice(const Slice &slice) {
+        _slices.push_back(slice);
+        _starts.push_back(_size);
+        _size += slice.last - slice.first;
+    }
+
+    // cut evenly, so a merge that outgrows a slice leaves two halves, not a sliver
+    void addSlices(const Block &block) {
+        std::size_t n = block->size();
+        std::size_t pieces = (n + kSliceBids - 1) / kSliceBids;
+        for (std::size_t p = 0; p < pieces; p++) {
+            Slice slice = { block, n * p / pieces, n * (p + 1) / pieces };
+            addSlice(slice);
+        }
+    }
+
+    std::vector<Slice> _slices;
+    std::vector<std::size_t> _starts; // index of each slice's first bid
+    std::size_t _size;
+};
+
+#endif /*!_BIDLIST_HPP_*/
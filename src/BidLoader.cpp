@@ -0,0 +1,549 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <glob.h>
+#include <iostream>
+#include <mutex>
+#include <sys/stat.h>
+#include <unordered_map>
+#include "BidLoader.hpp"
+#include "Columnar.hpp"
+#include "Decompress.hpp"
+#include "Instrumentation.hpp"
+#include "MemoryBudget.hpp"
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+namespace {
+
+    // Where a bid came from: input order decides keep-first / keep-last
+    struct Origin {
+        uint32_t file;
+        uint32_t row;
+    };
+
+    /**
+     * Concurrent bidId -> winning Origin map, split into independently
+     * locked shards so loader threads rarely contend. Every file offers its
+     * rows as soon as it is parsed; the policy decides which offer sticks,
+     * so the result does not depend on which thread finished first.
+     */
+    class WinnerSet {
+    public:
+        explicit WinnerSet(DuplicatePolicy policy) : _policy(policy) {}
+
+        void offer(const string &bidId, Origin origin) {
+            Shard &s = shard(bidId);
+            lock_guard<mutex> guard(s.lock);
+            auto inserted = s.winners.insert(make_pair(bidId, origin));
+            if (!inserted.second && beats(origin, inserted.first->second)) {
+                inserted.first->second = origin;
+            }
+        }
+
+        // Only call once every offer() has returned (no locking)
+        bool isWinner(const string &bidId, Origin origin) const {
+            const Shard &s = _shards[hash<string>()(bidId) % kShards];
+            auto it = s.winners.find(bidId);
+            return it != s.winners.end() && it->second.file == origin.file && it->second.row == origin.row;
+        }
+
+    private:
+        static const size_t kShards = 64;
+
+        struct Shard {
+            mutex lock;
+            unordered_map<string, Origin> winners;
+        };
+
+        Shard &shard(const string &bidId) {
+            return _shards[hash<string>()(bidId) % kShards];
+        }
+
+        bool beats(Origin candidate, Origin current) const {
+            bool earlier = candidate.file < current.file ||
+                           (candidate.file == current.file && candidate.row < current.row);
+            return _policy == eKEEP_FIRST ? earlier : !earlier;
+        }
+
+        Shard _shards[kShards];
+        const DuplicatePolicy _policy;
+    };
+
+    double secondsSince(chrono::steady_clock::time_point start) {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Column layout of the eBid export, **hardcoded for now**
+    Bid rowToBid(const csv::Row &row) {
+        Bid bid;
+        bid.title = row.field(0);
+        bid.bidId = row.field(1);
+        bid.fund = row.field(8);
+        bid.amount = strToDouble(row.field(4), '$');
+        return bid;
+    }
+
+    /**
+     * Converts rows into bids and keeps what it added charged to mem::eBIDS
+     * until it goes out of scope (the caller then hands the vector to a
+     * BidList block, which charges it from there). The charge is brought
+     * up to date every few thousand bids; a load that has outgrown the
+     * memory budget by then stops with what it was using.
+     */
+    class BidCollector {
+    public:
+        BidCollector(vector<Bid> &bids, const string &source)
+            : _bids(bids), _source(source), _heap(0), _charge(mem::eBIDS), _convert(instr::eCONVERT) {}
+
+        void add(const csv::Row &row) {
+            Bid bid;
+            {
+                VS_SCOPE_INTO(_convert);
+                bid = rowToBid(row);
+            }
+            _heap += bidHeapBytes(bid);
+
+            // push this bid to the end
+            _bids.push_back(std::move(bid));
+            if (_bids.size() % kSettleEvery == 0) {
+                settle();
+            }
+        }
+
+        void settle() {
+            VS_FLUSH(_convert);
+            _charge.resize(_bids.capacity() * sizeof(Bid) + _heap);
+            if (mem::overBudget()) {
+                throw csv::Error("memory budget of " + mem::formatBytes(mem::budget()) + " exceeded loading " +
+                                 _source + " after " + to_string(_bids.size()) + " bids (" + mem::usage() + ")");
+            }
+        }
+
+    private:
+        BidCollector(const BidCollector &);
+        BidCollector &operator=(const BidCollector &);
+
+        static const size_t kSettleEvery = 4096;
+
+        vector<Bid> &_bids;
+        const string _source;
+        size_t _heap;
+        mem::Reservation _charge;
+        instr::PhaseTally _convert; // eCONVERT per row, recorded once per settle
+    };
+
+    // Convert every parsed row to a Bid and add it to bids
+    void appendBids(const csv::Parser &file, vector<Bid> &bids, BidCollector &collector) {
+        bids.reserve(bids.size() + file.rowCount());
+        VS_COUNT(eALLOCATIONS, 1);
+
+        //loop to read rows of a CSV file
+        //unsigned int to match csv::Parser rowCount() method
+        for (unsigned int i = 0; i < file.rowCount(); i++) {
+            collector.add(file[i]);
+        }
+        collector.settle();
+    }
+
+    enum InputKind {
+        eINPUT_FILE = 0,    // a regular CSV file (possibly .gz/.zst)
+        eINPUT_PIPE,        // "-" (stdin), a FIFO, <(process substitution): read once
+        eINPUT_COLUMNAR     // an exported .vsc file: mapped, not parsed
+    };
+
+    InputKind inputKind(const string &csvPath) {
+        if (isStreamedInput(csvPath)) {
+            return eINPUT_PIPE;
+        }
+        return isColumnarFile(csvPath) ? eINPUT_COLUMNAR : eINPUT_FILE;
+    }
+
+    // input sampled to estimate a budgeted load
+    const size_t kSampleBytes = 256 * 1024;
+
+    /**
+     * Estimate what loading csvPath will hold by parsing its first
+     * kSampleBytes and scaling by the file size. Input that can't be
+     * sampled (pipes, compressed or columnar files) comes back !known.
+     */
+    LoadPlan estimateLoad(const string &csvPath, InputKind kind, const csv::ReadOptions &options) {
+        LoadPlan plan;
+        plan.textBytes = options.bufferSize * max<size_t>(options.buffers, 2);
+        struct stat st;
+        if (kind != eINPUT_FILE || stat(csvPath.c_str(), &st) != 0 || st.st_size == 0) {
+            return plan;
+        }
+        string sample(min<size_t>(st.st_size, kSampleBytes), '\0');
+        ifstream in(csvPath.c_str(), ios::binary);
+        in.read(&sample[0], sample.size());
+        sample.resize(static_cast<size_t>(in.gcount()));
+        if (sample.empty() ||
+            csv::detectCompression(reinterpret_cast<const unsigned char *>(sample.data()), sample.size()) != csv::eNONE) {
+            return plan;
+        }
+        // whole lines only
+        if (sample.size() < static_cast<size_t>(st.st_size)) {
+            size_t end = sample.rfind('\n');
+            if (end == string::npos) {
+                return plan;
+            }
+            sample.resize(end + 1);
+        }
+
+        // streamed and measured, not kept: charging the sample would let a
+        // tight budget fail in here instead of in choosePath with the estimate
+        size_t rows = 0, rowBytes = 0, bidBytes = 0;
+        csv::Parser sampled(sample.data(), sample.size(), [&](const csv::Row &row) {
+            rows++;
+            rowBytes += row.footprint();
+            bidBytes += sizeof(Bid) + bidHeapBytes(rowToBid(row));
+        });
+
+        double scale = static_cast<double>(st.st_size) / sample.size();
+        plan.rows = static_cast<size_t>(rows * scale);
+        plan.rowBytes = static_cast<size_t>(rowBytes * scale);
+        plan.bidBytes = static_cast<size_t>(bidBytes * scale);
+        plan.known = true;
+        return plan;
+    }
+
+    /**
+     * Pick the path for a load that has been estimated: rows parsed first
+     * when rows and bids fit side by side, streamed when only the bids fit,
+     * streamed as well when nothing is known (the running checks still
+     * stop it at the budget). Throws the estimate when nothing fits.
+     */
+    void choosePath(LoadPlan &plan, const string &csvPath) {
+        if (!plan.known) {
+            plan.streamed = true;
+            return;
+        }
+        if (mem::fits(plan.textBytes + plan.rowBytes + plan.bidBytes)) {
+            plan.streamed = false;
+            return;
+        }
+        if (!mem::fits(plan.textBytes + plan.bidBytes)) {
+            throw csv::Error(csvPath + " would need about " + mem::formatBytes(plan.textBytes + plan.bidBytes) +
+                             " for ~" + to_string(plan.rows) + " bids even streamed (" +
+                             mem::formatBytes(plan.textBytes + plan.rowBytes + plan.bidBytes) +
+                             " parsing rows first), but only " + mem::formatBytes(mem::headroom()) + " of the " +
+                             mem::formatBytes(mem::budget()) + " memory budget is free");
+        }
+        plan.streamed = true;
+    }
+
+    /**
+     * Length of the line break at offset in path, where a last line that was
+     * loaded without one ends: 0 while nothing (or only a '\r') follows yet.
+     *
+     * @throws csv::Error when that line was still being written at load time
+     */
+    size_t lineBreakAt(const string &path, size_t offset) {
+        ifstream in(path, ios::binary);
+        char next[2];
+        in.seekg(static_cast<streamoff>(offset));
+        in.read(next, sizeof(next));
+        streamsize got = in.gcount();
+        if (got >= 1 && next[0] == '\n') {
+            return 1;
+        }
+        if (got == 2 && next[0] == '\r' && next[1] == '\n') {
+            return 2;
+        }
+        if (got == 0 || (got == 1 && next[0] == '\r')) {
+            return 0;
+        }
+        throw csv::Error("the last line of " + path + " grew after it was loaded: reload it");
+    }
+
+    // Read one input along the chosen path
+    vector<Bid> readBids(const string &csvPath, InputKind kind, const LoadPlan &plan,
+                         const csv::ReadOptions &options, TailPosition *position) {
+        // exported columnar files are mapped, not parsed (and can't be tailed)
+        if (kind == eINPUT_COLUMNAR) {
+            if (position) {
+                *position = TailPosition();
+            }
+            return readColumnar(csvPath);
+        }
+
+        VS_SCOPE(eLOAD);
+
+        // "-" (stdin), FIFOs and <(process substitution) are streamed once:
+        // nothing to map, tail or sync
+        csv::DataType type = kind == eINPUT_PIPE ? csv::eSTREAM : csv::eFILE;
+
+        // Define a vector data structure to hold a collection of bids.
+        vector<Bid> bids;
+        BidCollector collector(bids, csvPath);
+        size_t offset;
+        bool compressed;
+        bool unterminated;
+        vector<string> header;
+        if (plan.streamed) {
+            // each row becomes a bid as soon as it is parsed; no csv::Row is
+            // kept. Reserving the estimate (plus slack) avoids a last doubling.
+            bids.reserve(plan.rows + plan.rows / 16);
+            csv::Parser file(csvPath, type, [&collector](const csv::Row &row) { collector.add(row); }, ',', options);
+            collector.settle();
+            offset = file.endOffset();
+            unterminated = file.unterminated();
+            compressed = file.compressed();
+            header = file.getHeader();
+        } else {
+            // initialize the CSV Parser using the given path (.gz/.zst are inflated on the fly)
+            csv::Parser file(csvPath, type, ',', options);
+            appendBids(file, bids, collector);
+            offset = file.endOffset();
+            unterminated = file.unterminated();
+            compressed = file.compressed();
+            header = file.getHeader();
+        }
+
+        if (position) {
+            // inflated offsets mean nothing to a tail of the compressed file
+            position->valid = kind == eINPUT_FILE && !compressed;
+            position->header = header;
+            position->offset = offset;
+            position->unterminated = unterminated;
+        }
+        return bids;
+    }
+}
+
+/**
+ * Simple C function to convert a string to a double
+ * after stripping out unwanted char
+ *
+ * credit: http://stackoverflow.com/a/24875936
+ *
+ * @param ch The character to strip out
+ */
+double strToDouble(string str, char ch) {
+    // Removes the specified character (ex '$')
+    str.erase(remove(str.begin(), str.end(), ch), str.end());
+    // Removes common numeric formatting characters like commas
+    str.erase(remove(str.begin(), str.end(), ','), str.end());
+    // Trim spaces just in case (extra whitespace)
+    str.erase(remove_if(str.begin(), str.end(), [](unsigned char c) { return std::isspace(c); }), str.end());
+    // Convert cleaned string to double
+    return atof(str.c_str());
+}
+
+bool isStreamedInput(const string &path) {
+    struct stat st;
+    return path == "-" || (stat(path.c_str(), &st) == 0 && !S_ISREG(st.st_mode));
+}
+
+size_t bidHeapBytes(const Bid &bid) {
+    return mem::heapBytes(bid.bidId) + mem::heapBytes(bid.title) + mem::heapBytes(bid.fund);
+}
+
+size_t bidsFootprint(const vector<Bid> &bids) {
+    size_t bytes = bids.capacity() * sizeof(Bid);
+    for (const Bid &bid: bids) {
+        bytes += bidHeapBytes(bid);
+    }
+    return bytes;
+}
+
+vector<Bid> parseBids(const string &csvPath, const csv::ReadOptions &options, TailPosition *position,
+                      LoadPlan *plan) {
+    InputKind kind = inputKind(csvPath);
+    LoadPlan local;
+    LoadPlan &chosen = plan ? *plan : local;
+    chosen = LoadPlan();
+    // columnar files check the budget themselves (see readColumnar)
+    if (mem::budget() && kind != eINPUT_COLUMNAR) {
+        chosen = estimateLoad(csvPath, kind, options);
+        choosePath(chosen, csvPath);
+    }
+    return readBids(csvPath, kind, chosen, options, position);
+}
+
+vector<Bid> tailBids(const string &csvPath, TailPosition &position) {
+    VS_SCOPE(eLOAD);
+    if (!position.valid) {
+        throw csv::Error("live tail needs a loaded, uncompressed CSV");
+    }
+
+    size_t offset = position.offset;
+    if (position.unterminated) {
+        offset += lineBreakAt(csvPath, offset);
+    }
+    csv::Parser appended(csvPath, position.header, offset);
+
+    vector<Bid> bids;
+    BidCollector collector(bids, csvPath);
+    appendBids(appended, bids, collector);
+    position.unterminated = position.unterminated && appended.endOffset() == position.offset;
+    position.offset = appended.endOffset();
+    return bids;
+}
+
+/**
+ * Load a CSV file containing bids into a container
+ *
+ * @param csvPath the path to the CSV file to load
+ * @param options read buffer size / direct I/O for the background reader
+ * @return a container holding all the bids read
+ */
+vector<Bid> loadBids(string csvPath, const csv::ReadOptions &options, TailPosition *position, LoadPlan *plan) {
+    cout << "Loading CSV file " << csvPath << endl;
+
+    try {
+        return parseBids(csvPath, options, position, plan);
+    } catch (csv::Error &e) {
+        // a missing, corrupt or truncated file is reported, not fatal
+        std::cerr << e.what() << std::endl;
+    }
+    return vector<Bid>();
+}
+
+vector<string> expandInputs(const vector<string> &patterns) {
+    vector<string> paths;
+    for (const string &pattern: patterns) {
+        glob_t matches;
+        // GLOB_NOCHECK: an unmatched pattern comes back as itself, so the
+        // loader reports "Failed to open" instead of silently skipping it
+        if (glob(pattern.c_str(), GLOB_NOCHECK, NULL, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                paths.push_back(matches.gl_pathv[i]);
+            }
+        } else {
+            paths.push_back(pattern);
+        }
+        globfree(&matches);
+    }
+    return paths;
+}
+
+vector<Bid> loadBidFiles(const vector<string> &paths, DuplicatePolicy policy, unsigned int threads,
+                         const csv::ReadOptions &options, LoadStats *stats) {
+    LoadStats local;
+    LoadStats &st = stats ? *stats : local;
+    st = LoadStats();
+    st.files = paths.size();
+
+    if (threads == 0) {
+        threads = ThreadPool::defaultThreads();
+    }
+    st.threads = static_cast<unsigned int>(min<size_t>(threads, max<size_t>(paths.size(), 1)));
+
+    vector<vector<Bid> > perFile(paths.size());
+    vector<double> seconds(paths.size(), 0.0);
+    vector<string> errors(paths.size());
+    vector<size_t> charged(paths.size(), 0); // each file's bids, charged to mem::eBIDS until merged
+    WinnerSet winners(policy);
+
+    // Under a memory budget every file is streamed (no file's rows are held
+    // at once), and the set is only read when all of its bids, the merged
+    // vector's slots and a reader per thread fit.
+    vector<InputKind> kinds(paths.size());
+    vector<LoadPlan> plans(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        kinds[i] = inputKind(paths[i]);
+    }
+    if (mem::budget()) {
+        st.streamed = true;
+        size_t rows = 0;
+        size_t needed = options.bufferSize * max<size_t>(options.buffers, 2) * st.threads;
+        for (size_t i = 0; i < paths.size(); i++) {
+            try {
+                plans[i] = estimateLoad(paths[i], kinds[i], options);
+            } catch (csv::Error &) {
+                // unreadable or corrupt: reported when the file is loaded
+            }
+            plans[i].streamed = true;
+            rows += plans[i].rows;
+            needed += plans[i].bidBytes + plans[i].rows * sizeof(Bid);
+        }
+        if (!mem::fits(needed)) {
+            st.errors.push_back("memory budget: the " + to_string(paths.size()) + " files would need about " +
+                                mem::formatBytes(needed) + " for ~" + to_string(rows) +
+                                " bids (each streamed, then merged), but only " + mem::formatBytes(mem::headroom()) +
+                                " of the " + mem::formatBytes(mem::budget()) + " budget is free");
+            return vector<Bid>();
+        }
+    }
+
+    {
+        ThreadPool pool(st.threads);
+        vector<future<void> > pending;
+        for (size_t i = 0; i < paths.size(); i++) {
+            pending.push_back(pool.submit([&, i] {
+                auto start = chrono::steady_clock::now();
+                try {
+                    perFile[i] = readBids(paths[i], kinds[i], plans[i], options, NULL);
+                    charged[i] = bidsFootprint(perFile[i]);
+                    mem::charge(mem::eBIDS, charged[i]);
+                } catch (exception &e) {
+                    // a bad_alloc as well as a csv::Error: one file failing must
+                    // not take the process (and the other files' charges) with it
+                    errors[i] = paths[i] + ": " + e.what();
+                }
+                // de-duplicate while other files are still parsing
+                const vector<Bid> &bids = perFile[i];
+                for (size_t r = 0; r < bids.size(); r++) {
+                    if (!bids[r].bidId.empty()) {
+                        Origin origin = { static_cast<uint32_t>(i), static_cast<uint32_t>(r) };
+                        winners.offer(bids[r].bidId, origin);
+                    }
+                }
+                seconds[i] = secondsSince(start);
+            }));
+        }
+        for (auto &done: pending) {
+            done.get();
+        }
+    }
+
+    // merge in input order, keeping only each bidId's winner
+    VS_SCOPE(eMERGE);
+    size_t total = 0;
+    for (size_t i = 0; i < perFile.size(); i++) {
+        total += perFile[i].size();
+        st.slowestFileSeconds = max(st.slowestFileSeconds, seconds[i]);
+        st.totalFileSeconds += seconds[i];
+        if (!errors[i].empty()) {
+            st.errors.push_back(errors[i]);
+        }
+    }
+
+    vector<Bid> merged;
+    merged.reserve(total);
+    mem::Reservation mergedSlots(mem::eBIDS, merged.capacity() * sizeof(Bid));
+    size_t movedHeap = 0;
+    for (size_t i = 0; i < perFile.size(); i++) {
+        for (size_t r = 0; r < perFile[i].size(); r++) {
+            Bid &bid = perFile[i][r];
+            Origin origin = { static_cast<uint32_t>(i), static_cast<uint32_t>(r) };
+            if (bid.bidId.empty() || winners.isWinner(bid.bidId, origin)) {
+                merged.push_back(std::move(bid));
+            }
+        }
+        // release each file's leftovers as soon as it is merged; the
+        // strings of its winners now belong to merged
+        size_t slots = min(perFile[i].capacity() * sizeof(Bid), charged[i]);
+        vector<Bid>().swap(perFile[i]);
+        mem::release(mem::eBIDS, slots);
+        movedHeap += charged[i] - slots;
+    }
+    // heavy de-duplication leaves most of the reservation unused
+    if (merged.size() < merged.capacity() / 2) {
+        merged.shrink_to_fit();
+    }
+    // handed over uncharged: the BidList block it becomes charges it
+    mem::release(mem::eBIDS, movedHeap);
+
+    st.rowsRead = total;
+    st.duplicates = total - merged.size();
+    VS_COUNT(eDUPLICATES, st.duplicates);
+    return merged;
+}
@@ -0,0 +1,116 @@
+#ifndef     _BIDLOADER_HPP_
+# define    _BIDLOADER_HPP_
+
+# include <string>
+# include <vector>
+# include "Bid.hpp"
+# include "CSVparser.hpp"
+
+// Which copy of a bidId survives when several input rows share it
+enum DuplicatePolicy {
+    eKEEP_FIRST = 0, // earliest file on the command line (then earliest row) wins
+    eKEEP_LAST = 1   // latest file (then latest row) wins, e.g. corrected re-exports
+};
+
+// What a multi-file load did, for the Load Bids summary box
+struct LoadStats {
+    size_t files;               // inputs attempted
+    size_t rowsRead;            // bids parsed before de-duplication
+    size_t duplicates;          // bids dropped by the policy
+    unsigned int threads;       // workers used
+    bool streamed;              // rows went straight into bids (memory budget)
+    double slowestFileSeconds;  // max(file) - the lower bound for the wall time
+    double totalFileSeconds;    // sum(files) - what a serial load would cost
+    std::vector<std::string> errors; // "path: message" for files that failed
+
+    LoadStats() : files(0), rowsRead(0), duplicates(0), threads(0), streamed(false),
+                  slowestFileSeconds(0.0), totalFileSeconds(0.0) {}
+};
+
+// Where a load stopped, so a live tail can parse only what was appended after it
+struct TailPosition {
+    std::vector<std::string> header; // reused for the appended rows
+    std::size_t offset;              // bytes parsed, through the last line
+    bool unterminated;               // that line had no '\n' yet (it is loaded all the same)
+    bool valid;                      // false until a load succeeds, or for .gz/.zst input
+
+    TailPosition() : offset(0), unterminated(false), valid(false) {}
+};
+
+// What a load under a memory budget (mem::setBudget) expected to need
+// and which path it took; estimates come from parsing a sample of the file
+struct LoadPlan {
+    std::size_t rows;       // projected bids
+    std::size_t textBytes;  // read buffers
+    std::size_t rowBytes;   // csv::Row objects, when the file is parsed before conversion
+    std::size_t bidBytes;   // the Bid records
+    bool known;             // false when nothing could be sampled (stdin, pipes, .gz/.zst)
+    bool streamed;          // rows were converted as they were parsed and never kept
+
+    LoadPlan() : rows(0), textBytes(0), rowBytes(0), bidBytes(0), known(false), streamed(false) {}
+};
+
+/**
+ * Parse one CSV file into bids (no console output). Columnar .vsc files
+ * (see Columnar.hpp) are recognised by their magic and mapped instead;
+ * "-" (stdin) and pipes are streamed.
+ *
+ * Under a memory budget the file is sampled first: when its parsed rows
+ * and bids would not fit together, rows are turned into bids as they are
+ * parsed; when even the bids would not fit, nothing is read.
+ *
+ * @param position optional, filled in for a later tailBids()
+ * @param plan optional, receives the estimate and the path taken
+ * @throws csv::Error when the file can't be opened or parsed, or doesn't
+ *         fit the memory budget (the message carries the estimate)
+ */
+std::vector<Bid> parseBids(const std::string &csvPath, const csv::ReadOptions &options = csv::ReadOptions(),
+                           TailPosition *position = NULL, LoadPlan *plan = NULL);
+
+/**
+ * Load a CSV file containing bids into a container, reporting errors
+ * on stderr (the original single-file menu path)
+ */
+std::vector<Bid> loadBids(std::string csvPath, const csv::ReadOptions &options = csv::ReadOptions(),
+                          TailPosition *position = NULL, LoadPlan *plan = NULL);
+
+/**
+ * Parse only the rows appended to csvPath since position and advance it.
+ * Cost is proportional to the new bytes, not the file size. A last line
+ * loaded without its '\n' is not read again: only the newline that
+ * completes it is skipped.
+ *
+ * @throws csv::Error when the file shrank (truncated/replaced: reload it),
+ *         more text was appended to that unterminated line, or an appended
+ *         row is malformed
+ */
+std::vector<Bid> tailBids(const std::string &csvPath, TailPosition &position);
+
+/**
+ * Whether path is read once, front to back: "-" (stdin), a FIFO or
+ * <(process substitution). Such input can't be loaded again, tailed or
+ * appended to.
+ */
+bool isStreamedInput(const std::string &path);
+
+/**
+ * Expand shell-style globs ("data/eBid_*.csv"); plain paths pass through.
+ * Matches of one pattern are sorted so keep-first/keep-last is stable.
+ */
+std::vector<std::string> expandInputs(const std::vector<std::string> &patterns);
+
+/**
+ * Parse every file concurrently on a thread pool and merge them into one
+ * dataset in input order, de-duplicating on bidId through a sharded
+ * concurrent hash set. Wall time is roughly the slowest file, not the sum.
+ * Under a memory budget every file is streamed, and a set of files whose
+ * bids would not fit is refused up front (reported in stats->errors).
+ *
+ * @param threads worker count (0 = one per core)
+ * @param stats optional summary of what happened
+ */
+std::vector<Bid> loadBidFiles(const std::vector<std::string> &paths, DuplicatePolicy policy,
+                              unsigned int threads, const csv::ReadOptions &options = csv::ReadOptions(),
+                              LoadStats *stats = NULL);
+
+#endif /*!_BIDLOADER_HPP_*/
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "BidRenderer.hpp"
+#include "Instrumentation.hpp"
+
+using namespace std;
+
+namespace {
+    // output is handed to write() once this much has been formatted
+    const size_t kBatchBytes = 1 << 20;
+
+    bool writeAll(int fd, const string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            done += n;
+        }
+        return true;
+    }
+
+    /**
+     * Same text as printf("%.2f") without the printf machinery, which is
+     * most of the cost of a row. Values within rounding noise of a half
+     * cent (where the two could round differently), huge values, NaN and
+     * inf still go through snprintf.
+     */
+    void appendAmount(string &out, double amount) {
+        double cents = fabs(amount) * 100.0;
+        if (!(cents < 1e15) || fabs(cents - floor(cents) - 0.5) < 1e-6) {
+            char text[400]; // room for DBL_MAX with two decimals
+            int length = snprintf(text, sizeof(text), "%.2f", amount);
+            out.append(text, length > 0 ? length : 0);
+            return;
+        }
+        unsigned long long value = static_cast<unsigned long long>(cents + 0.5);
+        char reversed[24];
+        size_t n = 0;
+        do {
+            reversed[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+            if (n == 2) {
+                reversed[n++] = '.';
+            }
+        } while (value > 0 || n < 4);
+
+        if (signbit(amount)) {
+            out.append(1, '-');
+        }
+        while (n > 0) {
+            out.append(1, reversed[--n]);
+        }
+    }
+
+    // Bid rows that fit on the terminal under the pager's status line
+    size_t pageRows() {
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 2) {
+            return size.ws_row - 2;
+        }
+        return 22;
+    }
+}
+
+void formatBid(string &out, const Bid &bid) {
+    out.append("Auction ID: ").append(bid.bidId)
+       .append(" | Title: ").append(bid.title)
+       .append(" | Winning Bid: $");
+    appendAmount(out, bid.amount);
+    out.append(" | Fund: ").append(bid.fund).append(1, '\n');
+}
+
+bool writeBids(int fd, const BidList &bids, size_t first, size_t last) {
+    VS_SCOPE(eRENDER);
+    string out;
+    out.reserve(kBatchBytes + 4096);
+    bool written = true;
+    bids.forEach(first, last, [&](const Bid &bid) {
+        if (!written) {
+            return;
+        }
+        formatBid(out, bid);
+        if (out.size() >= kBatchBytes) {
+            written = writeAll(fd, out);
+            out.clear();
+        }
+    });
+    return written && writeAll(fd, out);
+}
+
+void showBids(const BidList &bids) {
+    // whatever the menu already streamed must land before our raw writes
+    cout << flush;
+
+    size_t rows = pageRows();
+    if (!isatty(STDOUT_FILENO) || !isatty(STDIN_FILENO) || bids.size() <= rows) {
+        writeBids(STDOUT_FILENO, bids, 0, bids.size());
+        return;
+    }
+
+    // pager: only the window on screen is ever formatted
+    size_t lastPage = bids.size() - rows; // the last full screen
+    size_t top = 0;
+    while (true) {
+        string screen = "\x1b[2J\x1b[H";
+        size_t bottom = min(top + rows, bids.size());
+        {
+            VS_SCOPE(eRENDER);
+            bids.forEach(top, bottom, [&screen](const Bid &bid) { formatBid(screen, bid); });
+        }
+        screen.append("\x1b[7m rows ").append(to_string(top + 1)).append("-").append(to_string(bottom))
+              .append(" of ").append(to_string(bids.size()))
+              .append(" | Enter: next  b: back  g/G: first/last  <row>: jump  q: quit \x1b[0m ");
+        if (!writeAll(STDOUT_FILENO, screen)) {
+            return;
+        }
+
+        string key;
+        if (!getline(cin, key) || key == "q" || key == "Q") {
+            break;
+        }
+        if (key.empty() || key == " ") {
+            if (top == lastPage) {
+                break;
+            }
+            top = min(top + rows, lastPage);
+        } else if (key == "b") {
+            top = top > rows ? top - rows : 0;
+        } else if (key == "g") {
+            top = 0;
+        } else if (key == "G") {
+            top = lastPage;
+        } else if (isdigit(static_cast<unsigned char>(key[0]))) {
+            size_t row = static_cast<size_t>(strtoull(key.c_str(), NULL, 10));
+            top = min(row > 0 ? row - 1 : 0, lastPage);
+        }
+    }
+    cout << "\n";
+}
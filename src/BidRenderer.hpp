@@ -0,0 +1,31 @@
+#ifndef     _BIDRENDERER_HPP_
+# define    _BIDRENDERER_HPP_
+
+# include <cstddef>
+# include <string>
+# include <vector>
+# include "Bid.hpp"
+# include "BidList.hpp"
+
+/**
+ * Append one bid in the display format
+ * ("Auction ID: ... | Title: ... | Winning Bid: $... | Fund: ...\n")
+ */
+void formatBid(std::string &out, const Bid &bid);
+
+/**
+ * Write bids [first, last) to fd, formatted into large buffers with one
+ * write() per batch instead of several stream inserts per row
+ *
+ * @return false if a write failed (e.g. the reader of a pipe went away)
+ */
+bool writeBids(int fd, const BidList &bids, std::size_t first, std::size_t last);
+
+/**
+ * Display every bid. On a terminal, more rows than fit on the screen open a
+ * pager that formats only the visible window; otherwise (a pipe or file)
+ * everything is dumped through writeBids.
+ */
+void showBids(const BidList &bids);
+
+#endif /*!_BIDRENDERER_HPP_*/
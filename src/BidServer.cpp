@@ -0,0 +1,623 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "BidServer.hpp"
+#include "BidStore.hpp"
+#include "Columnar.hpp"
+#include "MemoryBudget.hpp"
+#include "SortKernels.hpp"
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+namespace {
+
+    // how often the poll loop looks at the stop flag
+    const int kPollMs = 250;
+    // a client that sends this much without a newline is cut off
+    const size_t kMaxLine = 64 * 1024;
+
+    // set by SHUTDOWN, SIGINT and SIGTERM
+    atomic<bool> gStop(false);
+
+    void onStopSignal(int) {
+        gStop = true;
+    }
+
+    const string &bidTitle(const Bid &bid) {
+        return bid.title;
+    }
+
+    /**
+     * One published version plus what queries need to answer from it in
+     * O(1) / O(log n): built once per version, shared by every connection.
+     */
+    struct View {
+        BidStore::Snapshot snapshot;
+        vector<const Bid *> rows;             // the snapshot's bids, O(1) by row
+        unordered_map<string, uint32_t> byId; // Auction ID -> row (first one wins)
+        vector<uint32_t> byTitle;             // rows in title order
+        vector<uint32_t> byAmount;            // rows by amount, highest first
+    };
+
+    shared_ptr<const View> buildView(const BidStore::Snapshot &snapshot) {
+        shared_ptr<View> view = make_shared<View>();
+        view->snapshot = snapshot;
+        vector<const Bid *> &rows = view->rows;
+        rows.reserve(snapshot->bids.size());
+        snapshot->bids.forEach(0, snapshot->bids.size(), [&rows](const Bid &bid) { rows.push_back(&bid); });
+
+        view->byId.reserve(rows.size());
+        view->byTitle.resize(rows.size());
+        for (uint32_t i = 0; i < rows.size(); i++) {
+            view->byId.insert(make_pair(rows[i]->bidId, i));
+            view->byTitle[i] = i;
+        }
+        view->byAmount = view->byTitle;
+
+        if (!snapshot->sortedByTitle) {
+            vsort::quickSort(view->byTitle.begin(), view->byTitle.end(),
+                             [&rows](uint32_t row) -> const string & { return rows[row]->title; });
+        }
+        stable_sort(view->byAmount.begin(), view->byAmount.end(),
+                    [&rows](uint32_t a, uint32_t b) { return rows[a]->amount > rows[b]->amount; });
+        return view;
+    }
+
+    void appendBid(string &out, const Bid &bid) {
+        char amount[32];
+        snprintf(amount, sizeof(amount), "%.2f", bid.amount);
+        out.append(bid.bidId).append(1, '\t').append(bid.title).append(1, '\t')
+           .append(amount).append(1, '\t').append(bid.fund).append(1, '\n');
+    }
+
+    string ok(const string &lines, size_t count) {
+        return "OK " + to_string(count) + "\n" + lines;
+    }
+
+    string err(const string &message) {
+        string line = message;
+        replace(line.begin(), line.end(), '\n', ' ');
+        return "ERR " + line + "\n";
+    }
+
+    bool sendAll(int fd, const string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            // MSG_NOSIGNAL: a client that hung up is an error, not SIGPIPE
+            ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            done += n;
+        }
+        return true;
+    }
+
+    // Next '\n'-terminated line from fd (without the newline / '\r')
+    bool readLine(int fd, string &buffer, string &line) {
+        while (true) {
+            size_t newline = buffer.find('\n');
+            if (newline != string::npos) {
+                line.assign(buffer, 0, newline);
+                buffer.erase(0, newline + 1);
+                if (!line.empty() && line[line.size() - 1] == '\r') {
+                    line.erase(line.size() - 1);
+                }
+                return true;
+            }
+            char chunk[4096];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, n);
+        }
+    }
+
+    /**
+     * Move the complete request lines at the front of buffer into requests
+     * (blank lines skipped, a trailing '\r' dropped). Returns true at QUIT;
+     * whatever follows it is discarded.
+     */
+    bool takeRequests(string &buffer, vector<string> &requests) {
+        size_t begin = 0, newline;
+        bool quit = false;
+        while (!quit && (newline = buffer.find('\n', begin)) != string::npos) {
+            string line = buffer.substr(begin, newline - begin);
+            begin = newline + 1;
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (line == "QUIT" || line == "quit") {
+                quit = true;
+            } else if (!line.empty()) {
+                requests.push_back(line);
+            }
+        }
+        buffer.erase(0, quit ? buffer.size() : begin);
+        return quit;
+    }
+
+    sockaddr_un socketAddress(const string &path) {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw csv::Error("socket path too long: " + path);
+        }
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    class Server {
+    public:
+        explicit Server(const ServerOptions &options) : _options(options) {}
+
+        // (Re)load paths into a new version; throws csv::Error if nothing could be read
+        string load(const vector<string> &paths) {
+            auto start = chrono::steady_clock::now();
+            LoadStats stats;
+            BidStore::Snapshot published = _store.rebuild([&](BidSnapshot &next) {
+                if (paths.size() == 1 && isColumnarFile(paths[0])) {
+                    // an exported file keeps its recorded sort order
+                    ColumnarScan scan;
+                    next.bids.assign(readColumnar(paths[0], ColumnarFilter(), &scan));
+                    next.sortedByTitle = scan.order == eORDER_TITLE;
+                    stats.files = 1;
+                } else if (paths.size() == 1) {
+                    next.bids.assign(parseBids(paths[0], _options.readOptions));
+                    stats.files = 1;
+                } else {
+                    next.bids.assign(loadBidFiles(paths, _options.policy, _options.loadThreads,
+                                                  _options.readOptions, &stats));
+                    if (stats.errors.size() == paths.size()) {
+                        throw csv::Error(stats.errors.front());
+                    }
+                }
+            }).get();
+            publish(published);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            ostringstream line;
+            line << "bids " << published->bids.size() << " version " << published->version
+                 << " files " << stats.files << " duplicates " << stats.duplicates
+                 << " errors " << stats.errors.size() << " seconds " << seconds << "\n";
+            return line.str();
+        }
+
+        string handle(const string &request) {
+            istringstream in(request);
+            string command;
+            in >> command;
+            for (size_t i = 0; i < command.size(); i++) {
+                command[i] = static_cast<char>(toupper(static_cast<unsigned char>(command[i])));
+            }
+
+            try {
+                if (command == "PING") {
+                    return ok("", 0);
+                }
+                if (command == "SHUTDOWN") {
+                    gStop = true;
+                    return ok("", 0);
+                }
+                if (command == "LOAD") {
+                    vector<string> patterns;
+                    string path;
+                    while (in >> path) {
+                        patterns.push_back(path);
+                    }
+                    return ok(load(expandInputs(patterns.empty() ? _options.inputs : patterns)), 1);
+                }
+                if (command == "SORT") {
+                    return sort();
+                }
+
+                shared_ptr<const View> view = atomic_load(&_view);
+                const vector<const Bid *> &bids = view->rows;
+                if (command == "STATS") {
+                    ostringstream line;
+                    line << "bids " << bids.size() << " version " << view->snapshot->version
+                         << " sorted " << (view->snapshot->sortedByTitle ? 1 : 0)
+                         << " memory " << mem::total() << "\n";
+                    return ok(line.str(), 1);
+                }
+                if (command == "LOOKUP") {
+                    string id;
+                    in >> id;
+                    auto found = view->byId.find(id);
+                    if (found == view->byId.end()) {
+                        return err("not found: " + id);
+                    }
+                    string out;
+                    appendBid(out, *bids[found->second]);
+                    return ok(out, 1);
+                }
+                if (command == "TOPK") {
+                    long k = 0;
+                    string by = "amount";
+                    in >> k >> by;
+                    if (k < 0 || (by != "amount" && by != "title")) {
+                        return err("usage: TOPK <k> [amount|title]");
+                    }
+                    const vector<uint32_t> &order = by == "title" ? view->byTitle : view->byAmount;
+                    size_t count = min(static_cast<size_t>(k), order.size());
+                    string out;
+                    for (size_t i = 0; i < count; i++) {
+                        appendBid(out, *bids[order[i]]);
+                    }
+                    return ok(out, count);
+                }
+                if (command == "RANGE") {
+                    string range;
+                    getline(in >> ws, range);
+                    size_t dots = range.find("..");
+                    if (dots == string::npos) {
+                        return err("usage: RANGE <lo>..<hi>");
+                    }
+                    string lo = range.substr(0, dots);
+                    string hi = range.substr(dots + 2);
+                    auto title = [&bids](uint32_t row) -> const string & { return bids[row]->title; };
+                    auto first = lower_bound(view->byTitle.begin(), view->byTitle.end(), lo,
+                                             [&](uint32_t row, const string &key) { return title(row) < key; });
+                    auto last = hi.empty() ? view->byTitle.end()
+                                           : upper_bound(first, view->byTitle.end(), hi,
+                                                         [&](const string &key, uint32_t row) { return key < title(row); });
+                    string out;
+                    for (auto it = first; it != last; ++it) {
+                        appendBid(out, *bids[*it]);
+                    }
+                    return ok(out, last - first);
+                }
+                if (command == "EXPORT") {
+                    string path;
+                    getline(in >> ws, path);
+                    if (path.empty()) {
+                        return err("usage: EXPORT <path.vsc>");
+                    }
+                    writeColumnar(path, view->snapshot->bids, view->snapshot->sortedByTitle ? eORDER_TITLE : eORDER_NONE);
+                    return ok("wrote " + to_string(bids.size()) + " " + path + "\n", 1);
+                }
+                return err("unknown request: " + command);
+            } catch (exception &e) {
+                return err(e.what());
+            }
+        }
+
+    private:
+        string sort() {
+            auto start = chrono::steady_clock::now();
+            // already in title order: nothing to copy, publish or re-index
+            shared_ptr<const View> view = atomic_load(&_view);
+            if (view->snapshot->sortedByTitle) {
+                ostringstream line;
+                line << "sorted " << view->snapshot->bids.size() << " version " << view->snapshot->version
+                     << " engine none seconds 0\n";
+                return ok(line.str(), 1);
+            }
+            const char *engine = "none";
+            // a SORT queued behind another one finds the bids sorted and
+            // leaves that version as it is
+            auto unsorted = [](const BidSnapshot &current) { return !current.sortedByTitle; };
+            BidStore::Snapshot published = _store.modify(unsorted, [&](BidSnapshot &next) {
+                next.bids.rewrite([&](vector<Bid> &bids) {
+                    // same choice as menu 14: adaptive for presorted input, else
+                    // quick sort (in place, also when the merge buffer won't fit the budget)
+                    vsort::OrderSample sample = vsort::sampleOrder(bids.begin(), bids.end(), bidTitle);
+                    if (sample.presorted() && mem::fits(vsort::adaptiveScratchBytes<Bid>(bids.size()))) {
+                        vsort::adaptiveSort(bids.begin(), bids.end(), bidTitle);
+                        engine = "adaptive";
+                    } else {
+                        vsort::quickSort(bids.begin(), bids.end(), bidTitle);
+                        engine = "quick";
+                    }
+                });
+                next.sortedByTitle = true;
+            }).get();
+            publish(published);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            ostringstream line;
+            line << "sorted " << published->bids.size() << " version " << published->version
+                 << " engine " << engine << " seconds " << seconds << "\n";
+            return ok(line.str(), 1);
+        }
+
+        // Index a freshly published version; a slower build of an older
+        // version never replaces a newer view
+        void publish(const BidStore::Snapshot &snapshot) {
+            shared_ptr<const View> current = atomic_load(&_view);
+            if (current && current->snapshot->version >= snapshot->version) {
+                return; // already indexed (an unchanged version) or superseded
+            }
+            shared_ptr<const View> view = buildView(snapshot);
+            lock_guard<mutex> guard(_publishLock);
+            current = atomic_load(&_view);
+            if (!current || current->snapshot->version < snapshot->version) {
+                atomic_store(&_view, view);
+            }
+        }
+
+        const ServerOptions &_options;
+        BidStore _store;
+        shared_ptr<const View> _view;
+        mutex _publishLock;
+    };
+
+    // One client of the poll loop
+    struct Connection {
+        string buffer;  // bytes read past the last complete request
+        bool busy;      // a batch of its requests is on the pool
+        bool closing;   // QUIT, hang-up or error: close once it is not busy
+
+        Connection() : busy(false), closing(false) {}
+    };
+
+    /**
+     * Serve every connection from one poll loop until gStop. Sockets are
+     * only read here; once a read completes at least one request line, the
+     * complete lines go to the pool as one batch, answered in a single
+     * write. The connection is not read again until its batch is done, so
+     * replies stay in request order, and an idle client costs a file
+     * descriptor rather than a worker. Workers hand finished connections
+     * back through done and a byte on the wake pipe.
+     */
+    void serveClients(Server &server, int listener, int wakeRead, int wakeWrite, unsigned int workers) {
+        unordered_map<int, Connection> clients;
+        mutex doneLock;
+        vector<pair<int, bool> > done; // fd, whether it can take more requests
+        {
+            ThreadPool pool(workers);
+            vector<pollfd> ready;
+            while (!gStop) {
+                ready.clear();
+                ready.push_back(pollfd{ listener, POLLIN, 0 });
+                ready.push_back(pollfd{ wakeRead, POLLIN, 0 });
+                for (const auto &client: clients) {
+                    if (!client.second.busy) {
+                        ready.push_back(pollfd{ client.first, POLLIN, 0 });
+                    }
+                }
+                if (poll(ready.data(), ready.size(), kPollMs) <= 0) {
+                    continue;
+                }
+
+                if (ready[1].revents) {
+                    char drain[64];
+                    while (read(wakeRead, drain, sizeof(drain)) > 0) {
+                    }
+                    vector<pair<int, bool> > finished;
+                    {
+                        lock_guard<mutex> guard(doneLock);
+                        finished.swap(done);
+                    }
+                    for (const auto &batch: finished) {
+                        Connection &client = clients[batch.first];
+                        client.busy = false;
+                        if (client.closing || !batch.second) {
+                            close(batch.first);
+                            clients.erase(batch.first);
+                        }
+                    }
+                }
+
+                for (size_t i = 2; i < ready.size(); i++) {
+                    if (!ready[i].revents) {
+                        continue;
+                    }
+                    int fd = ready[i].fd;
+                    Connection &client = clients[fd];
+                    char chunk[4096];
+                    ssize_t got = read(fd, chunk, sizeof(chunk));
+                    if (got < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (got > 0) {
+                        client.buffer.append(chunk, got);
+                    } else {
+                        client.closing = true;
+                    }
+
+                    vector<string> requests;
+                    if (takeRequests(client.buffer, requests)) {
+                        client.closing = true;
+                    }
+                    bool tooLong = client.buffer.size() > kMaxLine;
+                    if (requests.empty() && !tooLong) {
+                        if (client.closing) {
+                            close(fd);
+                            clients.erase(fd);
+                        }
+                        continue;
+                    }
+                    client.busy = true;
+                    pool.submit([&server, &doneLock, &done, wakeWrite, fd, requests, tooLong] {
+                        string replies;
+                        for (const string &request: requests) {
+                            replies += server.handle(request);
+                        }
+                        if (tooLong) {
+                            replies += err("request line too long");
+                        }
+                        bool sent = sendAll(fd, replies);
+                        {
+                            lock_guard<mutex> guard(doneLock);
+                            done.push_back(make_pair(fd, sent && !tooLong));
+                        }
+                        char byte = 0;
+                        ssize_t woke = write(wakeWrite, &byte, 1); // a full pipe is already a wake-up
+                        (void)woke;
+                    });
+                }
+
+                if (ready[0].revents) {
+                    int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+                    if (fd >= 0) {
+                        clients[fd];
+                    }
+                }
+            }
+            // ~ThreadPool: batches still queued are answered first
+        }
+        for (const auto &client: clients) {
+            close(client.first);
+        }
+    }
+}
+
+int serveBids(const ServerOptions &options) {
+    Server server(options);
+    try {
+        cout << "Loading " << server.load(expandInputs(options.inputs)) << flush;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        cerr << "socket: " << strerror(errno) << endl;
+        return 1;
+    }
+    sockaddr_un address;
+    try {
+        address = socketAddress(options.socketPath);
+    } catch (csv::Error &e) {
+        cerr << e.what() << endl;
+        close(listener);
+        return 1;
+    }
+    // a socket left behind by a server that died is replaced; anything else is not
+    struct stat st;
+    if (lstat(options.socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(options.socketPath.c_str());
+    }
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, 64) != 0) {
+        cerr << "Cannot listen on " << options.socketPath << ": " << strerror(errno) << endl;
+        close(listener);
+        return 1;
+    }
+
+    // no SA_RESTART: poll() returns so the loops see the flag
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = onStopSignal;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    // workers wake the poll loop when a connection's batch is answered
+    int wake[2];
+    if (pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        cerr << "pipe: " << strerror(errno) << endl;
+        close(listener);
+        unlink(options.socketPath.c_str());
+        return 1;
+    }
+
+    unsigned int workers = options.workers ? options.workers : max(4u, ThreadPool::defaultThreads());
+    cout << "Serving on " << options.socketPath << " with " << workers << " worker(s)" << endl;
+    serveClients(server, listener, wake[0], wake[1], workers);
+    close(wake[0]);
+    close(wake[1]);
+    close(listener);
+    unlink(options.socketPath.c_str());
+    cout << "Server stopped." << endl;
+    return 0;
+}
+
+int askServer(const string &socketPath, const vector<string> &requests) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address;
+    try {
+        address = socketAddress(socketPath);
+    } catch (csv::Error &e) {
+        cerr << e.what() << endl;
+        close(fd);
+        return 1;
+    }
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        cerr << "Cannot connect to " << socketPath << ": " << strerror(errno) << endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+
+    int status = 0;
+    string buffer;
+    auto ask = [&](const string &request) -> bool {
+        if (request.empty()) {
+            return true;
+        }
+        // the server closes on QUIT without a reply
+        string command = request[request.size() - 1] == '\r' ? request.substr(0, request.size() - 1) : request;
+        if (command == "QUIT" || command == "quit") {
+            sendAll(fd, request + "\n");
+            return false;
+        }
+        string line;
+        if (!sendAll(fd, request + "\n") || !readLine(fd, buffer, line)) {
+            cerr << "Connection to " << socketPath << " closed" << endl;
+            status = 1;
+            return false;
+        }
+        if (line.compare(0, 3, "OK ") != 0) {
+            cerr << line << endl;
+            status = 1;
+            return true;
+        }
+        long lines = atol(line.c_str() + 3);
+        string out;
+        for (long i = 0; i < lines; i++) {
+            if (!readLine(fd, buffer, line)) {
+                status = 1;
+                return false;
+            }
+            out.append(line).append(1, '\n');
+        }
+        cout << out;
+        return true;
+    };
+
+    if (requests.empty()) {
+        string request;
+        while (getline(cin, request) && ask(request)) {
+        }
+    } else {
+        for (const string &request: requests) {
+            if (!ask(request)) {
+                break;
+            }
+        }
+    }
+    cout << flush;
+    close(fd);
+    return status;
+}
@@ -0,0 +1,57 @@
+#ifndef     _BIDSERVER_HPP_
+# define    _BIDSERVER_HPP_
+
+# include <string>
+# include <vector>
+# include "BidLoader.hpp"
+
+/*
+** Resident server (--serve=SOCKET): the bids are loaded once, kept in a
+** BidStore together with an Auction ID index and title / amount orders,
+** and queried over a Unix domain socket. One request per line:
+**
+**   PING                        OK 0
+**   STATS                       OK 1   bids N, version V, sorted 0|1, memory bytes
+**   LOAD [path ...]             OK 1   reload (default: the startup inputs)
+**   SORT                        OK 1   publish a title-sorted version (unless already sorted)
+**   LOOKUP <auction id>         OK 1   the bid, or ERR not found
+**   TOPK <k> [amount|title]     OK n   highest amounts (default) or first titles
+**   RANGE <lo>..<hi>            OK n   titles in [lo, hi] (either end may be empty)
+**   EXPORT <path.vsc>           OK 1   write the current version as columnar
+**   QUIT                        close this connection
+**   SHUTDOWN                    OK 0, then stop the server
+**
+** A reply is "OK <lines>" followed by that many lines, or a single
+** "ERR <message>" line. A bid line is: id TAB title TAB amount TAB fund.
+** Requests can be pipelined; the replies come back in order.
+*/
+
+struct ServerOptions {
+    std::string socketPath;
+    std::vector<std::string> inputs; // loaded at startup and by a bare LOAD
+    DuplicatePolicy policy;
+    unsigned int loadThreads;        // multi-file loader threads (0 = one per core)
+    unsigned int workers;            // requests answered at once (0 = max(4, cores))
+    csv::ReadOptions readOptions;
+
+    ServerOptions() : policy(eKEEP_FIRST), loadThreads(0), workers(0) {}
+};
+
+/**
+ * Load options.inputs and answer requests on options.socketPath until
+ * SHUTDOWN, SIGINT or SIGTERM. The socket file is removed on the way out.
+ *
+ * @return process exit status
+ */
+int serveBids(const ServerOptions &options);
+
+/**
+ * Client side for scripts (--connect=SOCKET): send each request (or each
+ * stdin line when there are none) and print the reply lines to stdout,
+ * errors to stderr.
+ *
+ * @return 0 when every request got OK
+ */
+int askServer(const std::string &socketPath, const std::vector<std::string> &requests);
+
+#endif /*!_BIDSERVER_HPP_*/
@@ -0,0 +1,104 @@
+#ifndef     _BIDSTORE_HPP_
+# define    _BIDSTORE_HPP_
+
+# include <cstdint>
+# include <functional>
+# include <future>
+# include <memory>
+# include "BidList.hpp"
+# include "MemoryBudget.hpp"
+# include "ThreadPool.hpp"
+
+// One version of the loaded bids; never modified once it is published
+struct BidSnapshot {
+    BidList bids;
+    bool sortedByTitle; // tailed/added bids are merged in title order while true
+    uint64_t version;   // 0 = the empty store, +1 per publish
+
+    BidSnapshot() : sortedByTitle(false), version(0) {}
+};
+
+/**
+ * RCU-style holder of the current BidSnapshot. Readers take a reference
+ * with current() and keep using that version for as long as they hold it,
+ * without locks. Loads, sorts and appends build the next version on a
+ * background writer thread and publish it with one atomic pointer swap.
+ * A version is freed when its last reader lets go of it. Versions share
+ * the bid blocks an update didn't touch (see BidList), and each block stays
+ * charged to mem::eBIDS until no live version holds it.
+ */
+class BidStore {
+public:
+    typedef std::shared_ptr<const BidSnapshot> Snapshot;
+    // fills in the next version (the writer sets its version number)
+    typedef std::function<void(BidSnapshot &)> Builder;
+    // looks at the current version: false when a modify has nothing to do
+    typedef std::function<bool(const BidSnapshot &)> Check;
+
+    BidStore() : _current(std::make_shared<BidSnapshot>()), _writer(1) {}
+
+    Snapshot current() const {
+        return std::atomic_load(&_current);
+    }
+
+    /**
+     * Build the next version from a copy of the current one (sorts,
+     * appends); the copy shares its bid blocks. Updates run one at a time
+     * in submission order, each on top of the one before. If build throws,
+     * nothing is published and the future rethrows.
+     */
+    std::future<Snapshot> modify(Builder build) {
+        return submit(Check(), std::move(build), true);
+    }
+
+    /**
+     * modify() that first asks needed about the current version, as the
+     * writer sees it after every earlier update. If it says no, nothing is
+     * copied or published and the future holds the current version.
+     */
+    std::future<Snapshot> modify(Check needed, Builder build) {
+        return submit(std::move(needed), std::move(build), true);
+    }
+
+    // Build the next version from scratch (reloads: nothing to copy)
+    std::future<Snapshot> rebuild(Builder build) {
+        return submit(Check(), std::move(build), false);
+    }
+
+private:
+    BidStore(const BidStore &);
+    BidStore &operator=(const BidStore &);
+
+    // Deleter of a published version: frees it and its memory charge
+    struct Release {
+        std::size_t bytes;
+
+        void operator()(const BidSnapshot *snapshot) const {
+            mem::release(mem::eBIDS, bytes);
+            delete snapshot;
+        }
+    };
+
+    std::future<Snapshot> submit(Check needed, Builder build, bool copy) {
+        return _writer.submit([this, needed, build, copy]() -> Snapshot {
+            Snapshot base = current();
+            if (needed && !needed(*base)) {
+                return base;
+            }
+            std::unique_ptr<BidSnapshot> next(copy ? new BidSnapshot(*base) : new BidSnapshot());
+            build(*next);
+            next->version = base->version + 1;
+            // the bid blocks charge themselves; a version holds its slice table
+            Release release = { sizeof(BidSnapshot) + next->bids.tableBytes() };
+            mem::charge(mem::eBIDS, release.bytes);
+            Snapshot published(next.release(), release);
+            std::atomic_store(&_current, published);
+            return published;
+        });
+    }
+
+    Snapshot _current;  // swapped only by the writer thread
+    ThreadPool _writer; // one thread, declared last: drained before _current goes
+};
+
+#endif /*!_BIDSTORE_HPP_*/
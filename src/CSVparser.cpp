@@ -1,102 +1,376 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <sstream>
 #include <iomanip>
 #include "CSVparser.hpp"
+#include "AsyncReader.hpp"
+#include "Decompress.hpp"
+#include "Instrumentation.hpp"
+#include "MemoryBudget.hpp"
+#include "SortKernels.hpp"
 
 namespace csv {
 
-  Parser::Parser(const std::string &data, const DataType &type, char sep)
-    : _type(type), _sep(sep)
+  namespace
   {
-      std::string line;
-      if (type == eFILE)
+    // row memory is charged in steps this big, not one atomic add per row
+    const std::size_t kChargeStep = 1 << 20;
+
+    // what one copy of the header holds (every Row carries its own)
+    std::size_t headerFootprint(const std::vector<std::string> &header)
+    {
+      std::size_t bytes = header.size() * sizeof(std::string);
+      for (auto it = header.begin(); it != header.end(); it++)
+        bytes += mem::heapBytes(*it);
+      return bytes;
+    }
+
+    // what one Row holds, given what its copy of the header holds
+    std::size_t rowFootprint(const std::vector<std::string> &values, std::size_t headerBytes)
+    {
+      std::size_t bytes = sizeof(Row) + sizeof(Row *) + headerBytes + values.capacity() * sizeof(std::string);
+      for (auto it = values.begin(); it != values.end(); it++)
+        bytes += mem::heapBytes(*it);
+      return bytes;
+    }
+  }
+
+  Parser::Parser(const std::string &data, const DataType &type, char sep, const ReadOptions &options)
+    : _type(type), _sep(sep), _hasHeader(false), _compressed(false), _offset(0),
+      _lineEnd(0), _lineTerminated(false), _headerEnd(0), _unterminatedAt(std::string::npos),
+      _scratch(NULL), _streamed(0), _headerBytes(0), _rowBytes(0), _chargedBytes(0),
+      _allocTally(instr::eROW_ALLOC)
+  {
+      try
       {
-        _file = data;
-        std::ifstream ifile(_file.c_str());
-        if (ifile.is_open())
+        if (type == eFILE || type == eSTREAM)
         {
-            while (ifile.good())
-            {
-                getline(ifile, line);
-                if (line != "")
-                    _originalFile.push_back(line);
-            }
-            ifile.close();
-
-            if (_originalFile.size() == 0)
-              throw Error(std::string("No Data in ").append(_file));
-            
-            parseHeader();
-            parseContent();
+          _file = data;
+          read(options);
         }
         else
-            throw Error(std::string("Failed to open ").append(_file));
+        {
+          // parse the caller's string in place, no line copies
+          feed(data.data(), data.size());
+          finish();
+          if (!_hasHeader)
+            throw Error(std::string("No Data in pure content"));
+        }
+        settle();
       }
-      else
+      catch (...)
+      {
+        // no destructor for a half-built parser: free what was parsed
+        clear();
+        throw;
+      }
+      VS_COUNT(eALLOCATIONS, _content.size());
+      VS_COUNT(eROWS, _content.size());
+  }
+
+  Parser::Parser(const std::string &file, const DataType &type, const RowHandler &handler, char sep,
+                 const ReadOptions &options)
+    : _file(file), _type(type), _sep(sep), _hasHeader(false), _compressed(false), _offset(0),
+      _lineEnd(0), _lineTerminated(false), _headerEnd(0), _unterminatedAt(std::string::npos),
+      _handler(handler), _scratch(NULL), _streamed(0), _headerBytes(0), _rowBytes(0), _chargedBytes(0),
+      _allocTally(instr::eROW_ALLOC)
+  {
+      if (type == ePURE)
+        throw Error("streaming parse needs a file or a stream");
+      try
+      {
+        read(options);
+      }
+      catch (...)
       {
-        std::istringstream stream(data);
-        while (std::getline(stream, line))
-          if (line != "")
-            _originalFile.push_back(line);
-        if (_originalFile.size() == 0)
-          throw Error(std::string("No Data in pure content"));
-
-        parseHeader();
-        parseContent();
+        clear();
+        throw;
       }
+      VS_COUNT(eROWS, _streamed);
+  }
+
+  Parser::Parser(const char *data, std::size_t size, char sep)
+    : _type(ePURE), _sep(sep), _hasHeader(false), _compressed(false), _offset(0),
+      _lineEnd(0), _lineTerminated(false), _headerEnd(0), _unterminatedAt(std::string::npos),
+      _scratch(NULL), _streamed(0), _headerBytes(0), _rowBytes(0), _chargedBytes(0),
+      _allocTally(instr::eROW_ALLOC)
+  {
+      try
+      {
+        feed(data, size);
+        finish();
+        if (!_hasHeader)
+          throw Error(std::string("No Data in borrowed buffer"));
+        settle();
+      }
+      catch (...)
+      {
+        clear();
+        throw;
+      }
+      VS_COUNT(eALLOCATIONS, _content.size());
+      VS_COUNT(eROWS, _content.size());
+  }
+
+  Parser::Parser(const char *data, std::size_t size, const RowHandler &handler, char sep)
+    : _type(ePURE), _sep(sep), _hasHeader(false), _compressed(false), _offset(0),
+      _lineEnd(0), _lineTerminated(false), _headerEnd(0), _unterminatedAt(std::string::npos),
+      _handler(handler), _scratch(NULL), _streamed(0), _headerBytes(0), _rowBytes(0), _chargedBytes(0),
+      _allocTally(instr::eROW_ALLOC)
+  {
+      try
+      {
+        feed(data, size);
+        finish();
+        if (!_hasHeader)
+          throw Error(std::string("No Data in borrowed buffer"));
+      }
+      catch (...)
+      {
+        clear();
+        throw;
+      }
+      VS_COUNT(eROWS, _streamed);
+  }
+
+  Parser::Parser(const std::string &file, const std::vector<std::string> &header, std::size_t offset, char sep)
+    : _file(file), _type(eFILE), _sep(sep), _hasHeader(true), _compressed(false), _offset(offset), _header(header),
+      _lineEnd(0), _lineTerminated(false), _headerEnd(offset), _unterminatedAt(std::string::npos),
+      _scratch(NULL), _streamed(0), _headerBytes(headerFootprint(header)), _rowBytes(0), _chargedBytes(0),
+      _allocTally(instr::eROW_ALLOC)
+  {
+      try
+      {
+        // appended data is usually a few rows: read it straight, no reader thread
+        FileSource source(_file, ReadOptions(), offset);
+        std::vector<char> buffer(64 * 1024);
+        std::size_t size;
+        while ((size = source.read(&buffer[0], buffer.size())) > 0)
+            feed(&buffer[0], size);
+        // no finish(): a line without its newline may still be being written,
+        // endOffset() stops before it so the next tail picks it up whole
+        settle();
+      }
+      catch (...)
+      {
+        clear();
+        throw;
+      }
+      VS_COUNT(eALLOCATIONS, _content.size());
+      VS_COUNT(eROWS, _content.size());
   }
 
   Parser::~Parser(void)
+  {
+     clear();
+  }
+
+  void Parser::read(const ReadOptions &options)
+  {
+      // a background thread reads (and inflates .gz/.zst input) into the
+      // next buffer while this one is parsed; pipes go through the same
+      // reader and tokenizer, they just can't seek or bypass the cache
+      std::unique_ptr<ByteSource> source;
+      if (_type == eSTREAM && _file == "-")
+        source.reset(new FdSource(STDIN_FILENO, "stdin"));
+      else
+        source.reset(new FileSource(_file, options));
+      Compression compression;
+      AsyncReader reader(openDecompressed(std::move(source), &compression), options);
+      _compressed = compression != eNONE;
+
+      const char *chunk;
+      std::size_t size;
+      while (reader.next(chunk, size))
+          feed(chunk, size);
+      finish();
+
+      if (!_hasHeader)
+        throw Error(std::string("No Data in ").append(_file));
+  }
+
+  void Parser::clear(void)
   {
      std::vector<Row *>::iterator it;
 
      for (it = _content.begin(); it != _content.end(); it++)
           delete *it;
+     _content.clear();
+     _rowEnds.clear();
+     delete _scratch;
+     _scratch = NULL;
+     unaccount(_rowBytes);
+  }
+
+  bool Parser::account(std::size_t bytes)
+  {
+      _rowBytes += bytes;
+      if (_rowBytes - _chargedBytes < kChargeStep)
+          return false;
+      settle();
+      return true;
+  }
+
+  void Parser::unaccount(std::size_t bytes)
+  {
+      // set() may have grown a row since it was charged; never go below zero
+      _rowBytes -= std::min(bytes, _rowBytes);
+      if (_chargedBytes > _rowBytes)
+          settle();
+  }
+
+  void Parser::settle(void)
+  {
+      if (_rowBytes > _chargedBytes)
+          mem::charge(mem::eROWS, _rowBytes - _chargedBytes);
+      else
+          mem::release(mem::eROWS, _chargedBytes - _rowBytes);
+      _chargedBytes = _rowBytes;
+  }
+
+  std::string Parser::overBudget(void) const
+  {
+      std::string msg = "memory budget of " + mem::formatBytes(mem::budget()) + " exceeded parsing " +
+                        (_file.empty() ? std::string("pure content") : _file) + " after " +
+                        std::to_string(_content.size()) + " rows (" + mem::usage() + ")";
+      // a plain file says what the whole parse would have needed
+      struct stat st;
+      if (_type == eFILE && !_compressed && _offset > 0 && ::stat(_file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        msg += "; its rows alone would need about " +
+               mem::formatBytes(static_cast<std::size_t>(static_cast<double>(_rowBytes) * st.st_size / _offset));
+      return msg;
   }
 
-  void Parser::parseHeader(void)
+  void Parser::feed(const char *data, std::size_t size)
   {
-      std::stringstream ss(_originalFile[0]);
+      VS_SCOPE(eTOKENIZE);
+      const char *start = data;
+      const char *end = data + size;
+      const std::size_t base = _offset;
+      _offset += size;
+
+      while (data < end)
+      {
+          const char *newline = static_cast<const char *>(std::memchr(data, '\n', end - data));
+          if (newline == NULL)
+          {
+              // line continues in the next chunk
+              _pending.append(data, end - data);
+              break;
+          }
+          _lineEnd = base + (newline + 1 - start);
+          _lineTerminated = true;
+          if (_pending.empty())
+              parseLine(data, newline - data);
+          else
+          {
+              _pending.append(data, newline - data);
+              parseLine(_pending.data(), _pending.size());
+              _pending.clear();
+          }
+          data = newline + 1;
+      }
+      VS_FLUSH(_allocTally);
+  }
+
+  void Parser::finish(void)
+  {
+      // last line without a trailing newline
+      if (!_pending.empty())
+      {
+          VS_SCOPE(eTOKENIZE);
+          _lineEnd = _offset;
+          _lineTerminated = false;
+          parseLine(_pending.data(), _pending.size());
+          _pending.clear();
+          VS_FLUSH(_allocTally);
+      }
+  }
+
+  void Parser::parseLine(const char *line, std::size_t size)
+  {
+      // blank lines are skipped
+      if (size == 0)
+          return;
+      _unterminatedAt = _lineTerminated ? std::string::npos : _lineEnd;
+      if (!_hasHeader)
+      {
+          parseHeader(line, size);
+          _hasHeader = true;
+      }
+      else
+          parseRow(line, size);
+  }
+
+  void Parser::parseHeader(const char *line, std::size_t size)
+  {
+      std::stringstream ss(std::string(line, size));
       std::string item;
 
       while (std::getline(ss, item, _sep))
           _header.push_back(item);
+      _headerEnd = _lineEnd;
+      _headerBytes = headerFootprint(_header);
   }
 
-  void Parser::parseContent(void)
+  void Parser::parseRow(const char *line, std::size_t size)
   {
-     std::vector<std::string>::iterator it;
-     
-     it = _originalFile.begin();
-     it++; // skip header
+     bool quoted = false;
+     std::size_t tokenStart = 0;
+     std::size_t i = 0;
 
-     for (; it != _originalFile.end(); it++)
+     Row *row;
+     if (_handler)
      {
-         bool quoted = false;
-         int tokenStart = 0;
-         unsigned int i = 0;
-
-         Row *row = new Row(_header);
-
-         for (; i != it->length(); i++)
-         {
-              if (it->at(i) == '"')
-                  quoted = ((quoted) ? (false) : (true));
-              else if (it->at(i) == ',' && !quoted)
-              {
-                  row->push(it->substr(tokenStart, i - tokenStart));
-                  tokenStart = i + 1;
-              }
-         }
-
-         //end
-         row->push(it->substr(tokenStart, it->length() - tokenStart));
-
-         // if value(s) missing
-         if (row->size() != _header.size())
-          throw Error("corrupted data !");
-         _content.push_back(row);
+         // streaming: one Row is refilled for every line
+         if (_scratch == NULL)
+             _scratch = new Row(_header);
+         row = _scratch;
+         row->_values.clear();
      }
+     else
+     {
+         VS_SCOPE_INTO(_allocTally);
+         row = new Row(_header);
+     }
+
+     for (; i != size; i++)
+     {
+          if (line[i] == '"')
+              quoted = ((quoted) ? (false) : (true));
+          else if (line[i] == _sep && !quoted)
+          {
+              row->push(std::string(line + tokenStart, i - tokenStart));
+              tokenStart = i + 1;
+          }
+     }
+
+     //end
+     row->push(std::string(line + tokenStart, size - tokenStart));
+
+     // if value(s) missing
+     if (row->size() != _header.size())
+     {
+      if (row != _scratch)
+        delete row;
+      throw Error("corrupted data !");
+     }
+     if (_handler)
+     {
+      _handler(*row);
+      _streamed++;
+      return;
+     }
+     _content.push_back(row);
+     _rowEnds.push_back(_lineEnd);
+     // stop a load that outgrows the budget before the OOM killer does
+     if (account(rowFootprint(row->_values, _headerBytes)) && mem::overBudget())
+      throw Error(overBudget());
   }
 
   Row &Parser::getRow(unsigned int rowPosition) const
@@ -137,8 +411,11 @@ namespace csv {
   {
     if (pos < _content.size())
     {
+      unaccount(rowFootprint(_content[pos]->_values, _headerBytes));
       delete *(_content.begin() + pos);
       _content.erase(_content.begin() + pos);
+      if (pos < _rowEnds.size())
+        _rowEnds.resize(pos);
       return true;
     }
     return false;
@@ -154,50 +431,240 @@ namespace csv {
     if (pos <= _content.size())
     {
       _content.insert(_content.begin() + pos, row);
+      if (pos < _rowEnds.size())
+        _rowEnds.resize(pos);
+      account(rowFootprint(row->_values, _headerBytes));
       return true;
     }
+    delete row;
     return false;
   }
 
-  void Parser::sync(void) const
+  bool Parser::apply(const RowEdits &edits)
+  {
+    const std::size_t rows = _content.size();
+
+    std::vector<unsigned int> erase(edits._erase);
+    std::sort(erase.begin(), erase.end());
+    erase.erase(std::unique(erase.begin(), erase.end()), erase.end());
+    if (!erase.empty() && erase.back() >= rows)
+      return false;
+
+    // inserts by position; stable so same-position inserts keep their order
+    std::vector<std::size_t> order(edits._insert.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&edits](std::size_t a, std::size_t b) {
+      return edits._insert[a].first < edits._insert[b].first;
+    });
+    if (!order.empty() && edits._insert[order.back()].first > rows)
+      return false;
+    if (erase.empty() && order.empty())
+      return true;
+
+    // one compaction pass over the old rows, splicing the inserts in
+    std::vector<Row *> next;
+    next.reserve(rows - erase.size() + order.size());
+    std::size_t e = 0;
+    std::size_t k = 0;
+    for (std::size_t i = 0; i <= rows; i++)
+    {
+      for (; k < order.size() && edits._insert[order[k]].first == i; k++)
+      {
+        const std::vector<std::string> &values = edits._insert[order[k]].second;
+        Row *row = new Row(_header);
+        for (auto it = values.begin(); it != values.end(); it++)
+          row->push(*it);
+        next.push_back(row);
+        account(rowFootprint(row->_values, _headerBytes));
+      }
+      if (i == rows)
+        break;
+      if (e < erase.size() && erase[e] == i)
+      {
+        unaccount(rowFootprint(_content[i]->_values, _headerBytes));
+        delete _content[i];
+        e++;
+      }
+      else
+        next.push_back(_content[i]);
+    }
+    _content.swap(next);
+
+    std::size_t first = rows;
+    if (!erase.empty())
+      first = erase.front();
+    if (!order.empty())
+      first = std::min<std::size_t>(first, edits._insert[order.front()].first);
+    if (first < _rowEnds.size())
+      _rowEnds.resize(first);
+    return true;
+  }
+
+  namespace
   {
-    if (_type == DataType::eFILE)
+    void writeAt(int fd, const std::string &data, std::size_t offset, const std::string &file)
     {
-      std::ofstream f;
-      f.open(_file, std::ios::out | std::ios::trunc);
+      std::size_t done = 0;
+      while (done < data.size())
+      {
+        ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, offset + done);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          throw Error(std::string("Failed to write ").append(file).append(": ").append(std::strerror(errno)));
+        done += n;
+      }
+    }
 
-      // header
-      unsigned int i = 0;
-      for (auto it = _header.begin(); it != _header.end(); it++)
+    void appendLine(std::string &out, const std::vector<std::string> &values, char sep)
+    {
+      for (std::size_t i = 0; i < values.size(); i++)
       {
-        f << *it;
-        if (i < _header.size() - 1)
-          f << ",";
-        else
-          f << std::endl;
-        i++;
+        if (i)
+          out += sep;
+        out += values[i];
+      }
+      out += '\n';
+    }
+  }
+
+  void Parser::sync(void) const
+  {
+    // a streaming parse kept no rows to write back
+    if (_type != DataType::eFILE || _handler)
+      return;
+
+    // writing plain text over a .gz/.zst file would destroy it
+    if (_compressed)
+      throw Error(std::string("can't sync compressed input: ").append(_file));
+
+    // rows still exactly as parsed stay where they are on disk
+    std::size_t kept = 0;
+    while (kept < _rowEnds.size() && !_content[kept]->_modified)
+      kept++;
+    std::size_t offset = kept ? _rowEnds[kept - 1] : _headerEnd;
+    std::string out;
+    if (offset == _unterminatedAt)
+      out += '\n';
+    _rowEnds.resize(kept);
+
+    int fd = ::open(_file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw Error(std::string("Failed to open ").append(_file).append(": ").append(std::strerror(errno)));
+
+    // batch the changed rows into large writes instead of one per row
+    const std::size_t kFlush = 1 << 20;
+    try
+    {
+      for (std::size_t i = kept; i < _content.size(); i++)
+      {
+        appendLine(out, _content[i]->_values, _sep);
+        _content[i]->_modified = false;
+        _rowEnds.push_back(offset + out.size());
+        if (out.size() >= kFlush)
+        {
+          writeAt(fd, out, offset, _file);
+          offset += out.size();
+          out.clear();
+        }
       }
-     
-      for (auto it = _content.begin(); it != _content.end(); it++)
-        f << **it << std::endl;
-      f.close();
+      writeAt(fd, out, offset, _file);
+      offset += out.size();
+      if (::ftruncate(fd, offset) != 0)
+        throw Error(std::string("Failed to truncate ").append(_file).append(": ").append(std::strerror(errno)));
+    }
+    catch (...)
+    {
+      ::close(fd);
+      _rowEnds.clear();
+      throw;
     }
+    ::close(fd);
+    _unterminatedAt = std::string::npos;
+  }
+
+  void Parser::sortBy(unsigned int column, bool descending)
+  {
+    if (column >= _header.size())
+      throw Error("can't sort by this column (doesn't exist)");
+
+    // sort the Row pointers; the rows themselves never move (but nothing
+    // on disk is in place any more)
+    _rowEnds.clear();
+    auto key = [column](const Row *row) -> const std::string & { return row->field(column); };
+    if (descending)
+      vsort::quickSort(_content.begin(), _content.end(), key, std::greater<std::string>());
+    else
+      vsort::quickSort(_content.begin(), _content.end(), key);
   }
 
   const std::string &Parser::getFileName(void) const
   {
       return _file;    
   }
+
+  std::size_t Parser::endOffset(void) const
+  {
+      return _offset - _pending.size();
+  }
+
+  bool Parser::unterminated(void) const
+  {
+      return _unterminatedAt != std::string::npos;
+  }
+
+  bool Parser::compressed(void) const
+  {
+      return _compressed;
+  }
+
+  std::size_t Parser::rowBytes(void) const
+  {
+      return _rowBytes;
+  }
   
+  /*
+  ** ROW EDITS
+  */
+
+  void RowEdits::erase(unsigned int row)
+  {
+      _erase.push_back(row);
+  }
+
+  void RowEdits::insert(unsigned int pos, const std::vector<std::string> &values)
+  {
+      _insert.push_back(std::make_pair(pos, values));
+  }
+
+  bool RowEdits::empty(void) const
+  {
+      return _erase.empty() && _insert.empty();
+  }
+
+  void RowEdits::clear(void)
+  {
+      _erase.clear();
+      _insert.clear();
+  }
+
   /*
   ** ROW
   */
 
   Row::Row(const std::vector<std::string> &header)
-      : _header(header) {}
+      : _header(header), _modified(false) {}
 
   Row::~Row(void) {}
 
+  std::size_t Row::footprint(void) const
+  {
+    // the streaming scratch row keeps its grown capacity, so it measures
+    // the same as a row that was kept
+    return rowFootprint(_values, headerFootprint(_header));
+  }
+
   unsigned int Row::size(void) const
   {
     return _values.size();
@@ -208,6 +675,11 @@ namespace csv {
     _values.push_back(value);
   }
 
+  void Row::push(std::string &&value)
+  {
+    _values.push_back(std::move(value));
+  }
+
   bool Row::set(const std::string &key, const std::string &value) 
   {
     std::vector<std::string>::const_iterator it;
@@ -218,6 +690,7 @@ namespace csv {
         if (key == *it)
         {
           _values[pos] = value;
+          _modified = true;
           return true;
         }
         pos++;
@@ -232,6 +705,13 @@ namespace csv {
        throw Error("can't return this value (doesn't exist)");
   }
 
+  const std::string &Row::field(unsigned int valuePosition) const
+  {
+       if (valuePosition < _values.size())
+           return _values[valuePosition];
+       throw Error("can't return this value (doesn't exist)");
+  }
+
   const std::string Row::operator[](const std::string &key) const
   {
       std::vector<std::string>::const_iterator it;
@@ -1,11 +1,15 @@
 #ifndef     _CSVPARSER_HPP_
 # define    _CSVPARSER_HPP_
 
+# include <cstddef>
+# include <functional>
 # include <stdexcept>
 # include <string>
 # include <vector>
 # include <list>
+# include <utility>
 # include <sstream>
+# include "Instrumentation.hpp"
 
 namespace csv
 {
@@ -28,11 +32,14 @@ namespace csv
     	public:
             unsigned int size(void) const;
             void push(const std::string &);
+            void push(std::string &&);
             bool set(const std::string &, const std::string &); 
 
     	private:
+    		friend class Parser;
     		const std::vector<std::string> _header;
     		std::vector<std::string> _values;
+    		bool _modified; // set() since the last Parser::sync
 
         public:
 
@@ -51,20 +58,73 @@ namespace csv
             }
             const std::string operator[](unsigned int) const;
             const std::string operator[](const std::string &valueName) const;
+            // no-copy access for hot paths (sorting, loading)
+            const std::string &field(unsigned int) const;
+            // heap this row holds when a Parser keeps it, its header copy
+            // included (Parser::rowBytes() is the sum over the kept rows)
+            std::size_t footprint(void) const;
             friend std::ostream& operator<<(std::ostream& os, const Row &row);
             friend std::ofstream& operator<<(std::ofstream& os, const Row &row);
     };
 
+    // Receives each row of a streaming parse; the row is only valid during the call
+    typedef std::function<void(const Row &)> RowHandler;
+
     enum DataType {
         eFILE = 0,
-        ePURE = 1
+        ePURE = 1,
+        eSTREAM = 2  // a pipe, FIFO or "-" (stdin): read once front to back, never synced
+    };
+
+    // How eFILE input is read (see AsyncReader.hpp)
+    struct ReadOptions
+    {
+        std::size_t bufferSize; // bytes per read buffer
+        std::size_t buffers;    // buffers in flight (2 = double buffering)
+        bool directIO;          // try O_DIRECT / F_NOCACHE, bypassing the page cache
+
+        ReadOptions(void) : bufferSize(1 << 20), buffers(2), directIO(false) {}
+    };
+
+    // A batch of row edits that Parser::apply performs in one linear pass
+    class RowEdits
+    {
+      public:
+        // positions refer to the rows as they are before apply()
+        void erase(unsigned int row);
+        // insert before row pos (pos == rowCount() appends); inserts at the
+        // same pos keep the order they were queued in
+        void insert(unsigned int pos, const std::vector<std::string> &);
+        bool empty(void) const;
+        void clear(void);
+
+      private:
+        friend class Parser;
+        std::vector<unsigned int> _erase;
+        std::vector<std::pair<unsigned int, std::vector<std::string> > > _insert;
     };
 
     class Parser
     {
 
     public:
-        Parser(const std::string &, const DataType &type = eFILE, char sep = ',');
+        Parser(const std::string &, const DataType &type = eFILE, char sep = ',',
+               const ReadOptions &options = ReadOptions());
+        // streaming (eFILE / eSTREAM): every row goes to handler as soon as it
+        // is parsed and is not kept, so rowCount() stays 0 and memory stays
+        // flat whatever the input size; the header and endOffset() still work
+        Parser(const std::string &, const DataType &type, const RowHandler &handler, char sep = ',',
+               const ReadOptions &options = ReadOptions());
+        // borrowed buffer: parse caller-owned memory in place (ePURE, no copy
+        // of the text); it only has to outlive the constructor
+        Parser(const char *data, std::size_t size, char sep = ',');
+        // borrowed buffer, streamed: rows go to handler and nothing is kept or
+        // charged (to measure a sample of a file, see Row::footprint)
+        Parser(const char *data, std::size_t size, const RowHandler &handler, char sep = ',');
+        // live tail: parse only the complete lines appended to an uncompressed
+        // file since offset, reusing the header of an earlier parse
+        Parser(const std::string &, const std::vector<std::string> &header, std::size_t offset,
+               char sep = ',');
         ~Parser(void);
 
     public:
@@ -74,24 +134,72 @@ namespace csv
         std::vector<std::string> getHeader(void) const;
         const std::string getHeaderElement(unsigned int pos) const;
         const std::string &getFileName(void) const;
+        // input byte offset just past the last line parsed, i.e. the last
+        // '\n' or the end of a final line without one (counted in inflated
+        // bytes for .gz/.zst input)
+        std::size_t endOffset(void) const;
+        // true when the last line parsed had no '\n' (see endOffset)
+        bool unterminated(void) const;
+        bool compressed(void) const;
+        // heap held by the rows (charged to mem::eROWS, see MemoryBudget.hpp)
+        std::size_t rowBytes(void) const;
 
     public:
         bool deleteRow(unsigned int row);
         bool addRow(unsigned int pos, const std::vector<std::string> &);
+        // every erase/insert of the batch in one O(n + k log k) pass; false
+        // (and nothing changed) if a position is out of range
+        bool apply(const RowEdits &);
+        // write the rows back: the unchanged leading rows stay on disk as
+        // they are and only the rest of the file is rewritten; throws Error
+        // for .gz/.zst input rather than overwrite it with plain text
         void sync(void) const;
+        // reorder rows by the given column (plain string order), see SortKernels.hpp
+        void sortBy(unsigned int column, bool descending = false);
 
     protected:
-    	void parseHeader(void);
-    	void parseContent(void);
+        // split a chunk into lines, keeping a partial last line in _pending
+        void feed(const char *data, std::size_t size);
+        void finish(void);
+        void parseLine(const char *line, std::size_t size);
+    	void parseHeader(const char *line, std::size_t size);
+    	void parseRow(const char *line, std::size_t size);
 
     private:
+        void read(const ReadOptions &options);
+        // delete the rows and give back their memory charge
+        void clear(void);
+        // true when the bytes were charged (every kChargeStep, not per row)
+        bool account(std::size_t bytes);
+        void unaccount(std::size_t bytes);
+        void settle(void);
+        std::string overBudget(void) const;
+
         std::string _file;
         const DataType _type;
         const char _sep;
-        std::vector<std::string> _originalFile;
+        bool _hasHeader;
+        bool _compressed;
+        std::size_t _offset;
+        std::string _pending;
         std::vector<std::string> _header;
         std::vector<Row *> _content;
 
+        // where the leading rows still match the file, for sync
+        std::size_t _lineEnd;                       // end of the line being parsed
+        bool _lineTerminated;                       // ... and whether it has a newline
+        mutable std::size_t _headerEnd;             // file offset after the header line
+        mutable std::vector<std::size_t> _rowEnds;  // file offset after each unchanged leading row
+        mutable std::size_t _unterminatedAt;        // end of a final line lacking '\n' (npos: none)
+
+        RowHandler _handler;        // streaming parse: rows go here instead of _content
+        Row *_scratch;              // ... reusing this one Row
+        std::size_t _streamed;      // rows handed to _handler
+        std::size_t _headerBytes;   // what each Row's copy of the header holds
+        std::size_t _rowBytes;      // footprint of the rows in _content
+        std::size_t _chargedBytes;  // the part of it already charged to mem::eROWS
+        instr::PhaseTally _allocTally;  // eROW_ALLOC per row, recorded once per chunk fed
+
     public:
         Row &operator[](unsigned int row) const;
     };
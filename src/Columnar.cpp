@@ -0,0 +1,501 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "Columnar.hpp"
+#include "CSVparser.hpp"
+#include "Instrumentation.hpp"
+#include "MemoryBudget.hpp"
+
+using namespace std;
+
+namespace {
+
+    const char kMagic[8] = { 'V', 'S', 'C', 'O', 'L', '0', '1', '\0' };
+    const uint32_t kVersion = 1;
+
+    static_assert(sizeof(ColumnarHeader) == 64, "ColumnarHeader is part of the file format");
+    static_assert(sizeof(ColumnarGroup) == 96, "ColumnarGroup is part of the file format");
+
+    bool littleEndianHost() {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    }
+
+    // A plain decimal integer that round-trips exactly (no sign, no leading zeros)
+    bool parseId(const string &id, uint64_t &value) {
+        if (id.empty() || id.size() > 19 || (id.size() > 1 && id[0] == '0')) {
+            return false;
+        }
+        value = 0;
+        for (char c: id) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return true;
+    }
+
+    unsigned int bitsFor(uint64_t range) {
+        unsigned int bits = 0;
+        while (bits < 64 && (range >> bits) != 0) {
+            bits++;
+        }
+        return bits;
+    }
+
+    /*
+    ** Sequential writer that keeps every section 8-byte aligned
+    */
+    class Writer {
+    public:
+        explicit Writer(const string &path) : _path(path), _out(path.c_str(), ios::binary | ios::trunc), _pos(0) {
+            if (!_out.is_open()) {
+                throw csv::Error(string("Failed to create ").append(path));
+            }
+        }
+
+        uint64_t pos() const { return _pos; }
+
+        void bytes(const void *data, size_t size) {
+            _out.write(static_cast<const char *>(data), static_cast<streamsize>(size));
+            _pos += size;
+        }
+
+        template<typename T>
+        void value(const T &v) { bytes(&v, sizeof(v)); }
+
+        void align() {
+            static const char zeros[8] = { 0 };
+            if (_pos % 8) {
+                bytes(zeros, 8 - _pos % 8);
+            }
+        }
+
+        // uint32 offsets[count + 1] followed by the bytes, then padding
+        template<typename GetString>
+        void strings(size_t count, GetString get) {
+            uint32_t offset = 0;
+            value(offset);
+            for (size_t i = 0; i < count; i++) {
+                offset += static_cast<uint32_t>(get(i).size());
+                value(offset);
+            }
+            for (size_t i = 0; i < count; i++) {
+                const string &s = get(i);
+                bytes(s.data(), s.size());
+            }
+            align();
+        }
+
+        void rewrite(uint64_t at, const void *data, size_t size) {
+            _out.seekp(static_cast<streamoff>(at));
+            _out.write(static_cast<const char *>(data), static_cast<streamsize>(size));
+            _out.seekp(static_cast<streamoff>(_pos));
+        }
+
+        void close() {
+            _out.close();
+            if (_out.fail()) {
+                throw csv::Error(string("Failed to write ").append(_path));
+            }
+        }
+
+    private:
+        const string _path;
+        ofstream _out;
+        uint64_t _pos;
+    };
+
+    /*
+    ** Read-only mapping with bounds-checked section access
+    */
+    class Mapping {
+    public:
+        explicit Mapping(const string &path) : _path(path), _data(NULL), _size(0) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw csv::Error(string("Failed to open ").append(path));
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ColumnarHeader))) {
+                ::close(fd);
+                corrupt("shorter than its header");
+            }
+            _size = static_cast<size_t>(st.st_size);
+            void *mem = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (mem == MAP_FAILED) {
+                throw csv::Error(string("Failed to map ").append(path).append(": ").append(strerror(errno)));
+            }
+            _data = static_cast<const char *>(mem);
+        }
+
+        ~Mapping() {
+            if (_data) {
+                munmap(const_cast<char *>(_data), _size);
+            }
+        }
+
+        size_t size() const { return _size; }
+
+        // count objects of T at offset, all inside the file and aligned
+        template<typename T>
+        const T *at(uint64_t offset, uint64_t count = 1) const {
+            if (offset % alignof(T) != 0 || offset > _size || count > (_size - offset) / sizeof(T)) {
+                corrupt("section out of bounds");
+            }
+            return reinterpret_cast<const T *>(_data + offset);
+        }
+
+        void corrupt(const char *why) const {
+            throw csv::Error(string("corrupt columnar file ").append(_path).append(": ").append(why));
+        }
+
+    private:
+        Mapping(const Mapping &);
+        Mapping &operator=(const Mapping &);
+
+        const string _path;
+        const char *_data;
+        size_t _size;
+    };
+
+    /*
+    ** One string column (offsets + bytes) inside the mapping. Values are
+    ** checked as they are touched, so a skipped row group costs nothing.
+    */
+    class StringColumn {
+    public:
+        StringColumn(const Mapping &map, uint64_t offset, uint32_t count) : _map(map), _count(count) {
+            _offsets = map.at<uint32_t>(offset, static_cast<uint64_t>(count) + 1);
+            uint64_t bytesAt = offset + (static_cast<uint64_t>(count) + 1) * sizeof(uint32_t);
+            _bytes = map.at<char>(bytesAt, _offsets[count]);
+        }
+
+        // [data, data + size) of value i, no copy
+        const char *data(uint32_t i) const {
+            check(i);
+            return _bytes + _offsets[i];
+        }
+
+        size_t size(uint32_t i) const {
+            check(i);
+            return _offsets[i + 1] - _offsets[i];
+        }
+
+        int compare(uint32_t i, const string &other) const {
+            size_t n = min(size(i), other.size());
+            int c = memcmp(data(i), other.data(), n);
+            if (c != 0) {
+                return c;
+            }
+            return size(i) < other.size() ? -1 : size(i) > other.size() ? 1 : 0;
+        }
+
+    private:
+        void check(uint32_t i) const {
+            if (i >= _count || _offsets[i] > _offsets[i + 1] || _offsets[i + 1] > _offsets[_count]) {
+                _map.corrupt("string offsets out of order");
+            }
+        }
+
+        const Mapping &_map;
+        const uint32_t *_offsets;
+        const char *_bytes;
+        uint32_t _count;
+    };
+
+    bool titleInRange(const StringColumn &titles, uint32_t i, const ColumnarFilter &filter) {
+        return (filter.titleMin.empty() || titles.compare(i, filter.titleMin) >= 0) &&
+               (filter.titleMax.empty() || titles.compare(i, filter.titleMax) <= 0);
+    }
+
+    bool amountInRange(double amount, const ColumnarFilter &filter) {
+        return amount >= filter.amountMin && amount <= filter.amountMax;
+    }
+}
+
+void writeColumnar(const string &path, const BidList &bids, ColumnarOrder order, size_t rowGroupSize) {
+    VS_SCOPE(eEXPORT);
+    if (!littleEndianHost()) {
+        throw csv::Error("columnar files are little-endian; this host is not");
+    }
+    if (rowGroupSize == 0) {
+        rowGroupSize = 4096;
+    }
+
+    // fund dictionary in first-seen order
+    unordered_map<string, uint32_t> fundCodes;
+    vector<const string *> funds;
+    vector<uint32_t> codes;
+    codes.reserve(bids.size());
+    bids.forEach(0, bids.size(), [&](const Bid &bid) {
+        auto inserted = fundCodes.insert(make_pair(bid.fund, static_cast<uint32_t>(funds.size())));
+        if (inserted.second) {
+            funds.push_back(&inserted.first->first);
+        }
+        codes.push_back(inserted.first->second);
+    });
+    uint32_t fundWidth = funds.size() <= 0x100 ? 1 : funds.size() <= 0x10000 ? 2 : 4;
+
+    // readers only ever see the finished file
+    string tmpPath = path + ".tmp";
+    Writer out(tmpPath);
+    try {
+        ColumnarHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.order = order;
+        header.rows = bids.size();
+        header.rowGroupSize = static_cast<uint32_t>(rowGroupSize);
+        header.rowGroups = static_cast<uint32_t>((bids.size() + rowGroupSize - 1) / rowGroupSize);
+        out.value(header);
+
+        header.dictOffset = out.pos();
+        header.dictCount = static_cast<uint32_t>(funds.size());
+        out.strings(funds.size(), [&](size_t i) -> const string & { return *funds[i]; });
+
+        vector<ColumnarGroup> groups(header.rowGroups);
+        vector<uint64_t> ids;
+        vector<const Bid *> chunk;
+        for (uint32_t g = 0; g < header.rowGroups; g++) {
+            ColumnarGroup &group = groups[g];
+            memset(&group, 0, sizeof(group));
+            size_t first = static_cast<size_t>(g) * rowGroupSize;
+            size_t rows = min(rowGroupSize, bids.size() - first);
+            chunk.clear();
+            bids.forEach(first, first + rows, [&chunk](const Bid &bid) { chunk.push_back(&bid); });
+            group.firstRow = first;
+            group.rows = static_cast<uint32_t>(rows);
+            group.fundWidth = fundWidth;
+
+            // statistics
+            group.amountMin = group.amountMax = chunk[0]->amount;
+            for (size_t i = 1; i < rows; i++) {
+                group.amountMin = min(group.amountMin, chunk[i]->amount);
+                group.amountMax = max(group.amountMax, chunk[i]->amount);
+                if (chunk[i]->title < chunk[group.titleMinRow]->title) {
+                    group.titleMinRow = static_cast<uint32_t>(i);
+                }
+                if (chunk[group.titleMaxRow]->title < chunk[i]->title) {
+                    group.titleMaxRow = static_cast<uint32_t>(i);
+                }
+            }
+
+            group.titleOffset = out.pos();
+            out.strings(rows, [&](size_t i) -> const string & { return chunk[i]->title; });
+
+            // ids: frame of reference when every id is a plain integer
+            ids.resize(rows);
+            bool numeric = true;
+            for (size_t i = 0; i < rows && numeric; i++) {
+                numeric = parseId(chunk[i]->bidId, ids[i]);
+            }
+            group.idOffset = out.pos();
+            if (numeric) {
+                group.idEncoding = eIDS_FOR;
+                group.idMin = *min_element(ids.begin(), ids.end());
+                group.idMax = *max_element(ids.begin(), ids.end());
+                uint32_t bits = bitsFor(group.idMax - group.idMin);
+                out.value(group.idMin);
+                out.value(bits);
+                out.value(static_cast<uint32_t>(0));
+                vector<uint64_t> words((rows * bits + 63) / 64, 0);
+                for (size_t i = 0; i < rows && bits > 0; i++) {
+                    uint64_t delta = ids[i] - group.idMin;
+                    size_t bit = i * bits;
+                    words[bit / 64] |= delta << (bit % 64);
+                    if (bit % 64 + bits > 64) {
+                        words[bit / 64 + 1] |= delta >> (64 - bit % 64);
+                    }
+                }
+                if (!words.empty()) {
+                    out.bytes(&words[0], words.size() * sizeof(uint64_t));
+                }
+            } else {
+                group.idEncoding = eIDS_PLAIN;
+                out.strings(rows, [&](size_t i) -> const string & { return chunk[i]->bidId; });
+            }
+
+            group.fundOffset = out.pos();
+            for (size_t i = 0; i < rows; i++) {
+                uint32_t code = codes[first + i];
+                out.bytes(&code, fundWidth); // little-endian: the low bytes come first
+            }
+            out.align();
+
+            group.amountOffset = out.pos();
+            for (size_t i = 0; i < rows; i++) {
+                out.value(chunk[i]->amount);
+            }
+        }
+
+        header.groupsOffset = out.pos();
+        if (!groups.empty()) {
+            out.bytes(&groups[0], groups.size() * sizeof(ColumnarGroup));
+        }
+        header.fileSize = out.pos();
+        out.rewrite(0, &header, sizeof(header));
+        out.close();
+    } catch (...) {
+        remove(tmpPath.c_str());
+        throw;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        throw csv::Error(string("Failed to write ").append(path));
+    }
+}
+
+bool isColumnarFile(const string &path) {
+    // only regular files can be mapped; peeking at a pipe would eat its first bytes
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    char magic[sizeof(kMagic)];
+    ifstream in(path.c_str(), ios::binary);
+    return in.read(magic, sizeof(magic)) && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+vector<Bid> readColumnar(const string &path, const ColumnarFilter &filter, ColumnarScan *scan) {
+    VS_SCOPE(eLOAD);
+    Mapping map(path);
+    const ColumnarHeader &header = *map.at<ColumnarHeader>(0);
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        map.corrupt("bad magic");
+    }
+    if (header.version != kVersion) {
+        map.corrupt("unsupported version");
+    }
+    if (header.fileSize != map.size()) {
+        map.corrupt("size doesn't match its header (truncated copy?)");
+    }
+    if (!littleEndianHost()) {
+        throw csv::Error("columnar files are little-endian; this host is not");
+    }
+
+    // under a memory budget, refuse before decoding anything: every row
+    // becomes a Bid whose strings are copied out of the file (a filtered
+    // read decodes fewer rows, so it isn't held to the whole file)
+    size_t needed = static_cast<size_t>(header.rows) * sizeof(Bid) + map.size();
+    if (filter.empty() && !mem::fits(needed)) {
+        throw csv::Error(path + " would need about " + mem::formatBytes(needed) + " for " +
+                         to_string(header.rows) + " bids, but only " + mem::formatBytes(mem::headroom()) +
+                         " of the " + mem::formatBytes(mem::budget()) + " memory budget is free");
+    }
+
+    StringColumn funds(map, header.dictOffset, header.dictCount);
+    const ColumnarGroup *groups = map.at<ColumnarGroup>(header.groupsOffset, header.rowGroups);
+
+    ColumnarScan local;
+    ColumnarScan &st = scan ? *scan : local;
+    st = ColumnarScan();
+    st.groups = header.rowGroups;
+    st.order = header.order == eORDER_TITLE ? eORDER_TITLE : eORDER_NONE;
+
+    vector<Bid> bids;
+    bids.reserve(filter.empty() ? static_cast<size_t>(header.rows) : 0);
+    VS_COUNT(eALLOCATIONS, 1);
+
+    for (uint32_t g = 0; g < header.rowGroups; g++) {
+        const ColumnarGroup &group = groups[g];
+        if (group.rows == 0) {
+            continue;
+        }
+        StringColumn titles(map, group.titleOffset, group.rows);
+        if (group.titleMinRow >= group.rows || group.titleMaxRow >= group.rows) {
+            map.corrupt("title statistics out of range");
+        }
+
+        // skip the whole group when its statistics rule it out: only the
+        // directory entry and two titles were touched
+        bool skip = false;
+        if (filter.byAmount && (group.amountMax < filter.amountMin || group.amountMin > filter.amountMax)) {
+            skip = true;
+        }
+        if (filter.byTitle && ((!filter.titleMin.empty() && titles.compare(group.titleMaxRow, filter.titleMin) < 0) ||
+                               (!filter.titleMax.empty() && titles.compare(group.titleMinRow, filter.titleMax) > 0))) {
+            skip = true;
+        }
+        if (skip) {
+            st.groupsSkipped++;
+            continue;
+        }
+
+        const double *amounts = map.at<double>(group.amountOffset, group.rows);
+        if (group.fundWidth != 1 && group.fundWidth != 2 && group.fundWidth != 4) {
+            map.corrupt("bad fund code width");
+        }
+        const unsigned char *fundCodes = map.at<unsigned char>(group.fundOffset,
+                                                               static_cast<uint64_t>(group.rows) * group.fundWidth);
+
+        // ids: either packed integers or a string column
+        uint64_t idBase = 0;
+        uint32_t idBits = 0;
+        const uint64_t *idWords = NULL;
+        unique_ptr<StringColumn> idStrings;
+        if (group.idEncoding == eIDS_FOR) {
+            idBase = *map.at<uint64_t>(group.idOffset);
+            idBits = *map.at<uint32_t>(group.idOffset + 8);
+            if (idBits > 64) {
+                map.corrupt("bad id bit width");
+            }
+            idWords = map.at<uint64_t>(group.idOffset + 16, (static_cast<uint64_t>(group.rows) * idBits + 63) / 64);
+        } else if (group.idEncoding == eIDS_PLAIN) {
+            idStrings.reset(new StringColumn(map, group.idOffset, group.rows));
+        } else {
+            map.corrupt("unknown id encoding");
+        }
+
+        for (uint32_t i = 0; i < group.rows; i++) {
+            if ((filter.byAmount && !amountInRange(amounts[i], filter)) ||
+                (filter.byTitle && !titleInRange(titles, i, filter))) {
+                continue;
+            }
+            Bid bid;
+            bid.title.assign(titles.data(i), titles.size(i));
+            bid.amount = amounts[i];
+
+            uint32_t code = 0;
+            memcpy(&code, fundCodes + static_cast<size_t>(i) * group.fundWidth, group.fundWidth);
+            if (code >= header.dictCount) {
+                map.corrupt("fund code out of range");
+            }
+            bid.fund.assign(funds.data(code), funds.size(code));
+
+            if (idStrings) {
+                bid.bidId.assign(idStrings->data(i), idStrings->size(i));
+            } else {
+                uint64_t delta = 0;
+                if (idBits > 0) {
+                    size_t bit = static_cast<size_t>(i) * idBits;
+                    delta = idWords[bit / 64] >> (bit % 64);
+                    if (bit % 64 + idBits > 64) {
+                        delta |= idWords[bit / 64 + 1] << (64 - bit % 64);
+                    }
+                    if (idBits < 64) {
+                        delta &= (uint64_t(1) << idBits) - 1;
+                    }
+                }
+                char digits[24];
+                snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(idBase + delta));
+                bid.bidId = digits;
+            }
+            bids.push_back(std::move(bid));
+        }
+        st.rowsDecoded += group.rows;
+    }
+    VS_COUNT(eROWS, bids.size());
+    return bids;
+}
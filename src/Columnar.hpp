@@ -0,0 +1,121 @@
+#ifndef     _COLUMNAR_HPP_
+# define    _COLUMNAR_HPP_
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+# include "Bid.hpp"
+# include "BidList.hpp"
+
+/*
+** Columnar bid files (.vsc)
+**
+** A binary layout that this tool's loader and downstream tools can mmap
+** directly instead of re-parsing CSV text. Everything is little-endian
+** and every section starts on an 8-byte boundary:
+**
+**   ColumnarHeader                       (64 bytes, offset 0)
+**   fund dictionary                      uint32 offsets[count + 1] + bytes
+**   row group column chunks, per group:
+**     title   plain strings              uint32 offsets[rows + 1] + bytes
+**     bidId   frame of reference         uint64 base, uint32 bits, uint32 0,
+**                                        bit-packed uint64 words (id - base)
+**             or plain strings           (any id that isn't a plain integer)
+**     fund    dictionary codes           1, 2 or 4 bytes per row
+**     amount  plain doubles              double[rows]
+**   ColumnarGroup directory              one entry per row group
+**
+** Each directory entry carries min/max statistics so readers can skip a
+** whole row group without touching its column chunks.
+*/
+
+// Sort order of the rows when the file was written
+enum ColumnarOrder {
+    eORDER_NONE = 0,
+    eORDER_TITLE = 1 // ascending by title (byte order)
+};
+
+enum ColumnarIdEncoding {
+    eIDS_FOR = 0,   // frame of reference + bit packing
+    eIDS_PLAIN = 1  // offsets + bytes
+};
+
+struct ColumnarHeader {
+    char magic[8];          // "VSCOL01\0"
+    uint32_t version;       // 1
+    uint32_t order;         // ColumnarOrder
+    uint64_t rows;
+    uint32_t rowGroups;
+    uint32_t rowGroupSize;  // rows per group (the last one may be shorter)
+    uint64_t dictOffset;    // fund dictionary
+    uint32_t dictCount;
+    uint32_t reserved0;
+    uint64_t groupsOffset;  // ColumnarGroup[rowGroups]
+    uint64_t fileSize;      // guards against truncated copies
+};
+
+struct ColumnarGroup {
+    uint64_t firstRow;
+    uint32_t rows;
+    uint32_t idEncoding;    // ColumnarIdEncoding
+    uint64_t titleOffset;
+    uint64_t idOffset;
+    uint64_t fundOffset;
+    uint64_t amountOffset;
+    uint32_t fundWidth;     // bytes per fund code
+    uint32_t titleMinRow;   // rows (within the group) holding the min/max title
+    uint32_t titleMaxRow;
+    uint32_t reserved;
+    double amountMin;
+    double amountMax;
+    uint64_t idMin;         // eIDS_FOR only
+    uint64_t idMax;
+};
+
+/**
+ * Rows a reader wants; row groups whose statistics fall outside every
+ * range are skipped without being decoded. Empty bounds are open.
+ */
+struct ColumnarFilter {
+    bool byTitle;
+    std::string titleMin, titleMax; // inclusive
+    bool byAmount;
+    double amountMin, amountMax;    // inclusive
+
+    ColumnarFilter() : byTitle(false), byAmount(false), amountMin(0.0), amountMax(0.0) {}
+    bool empty() const { return !byTitle && !byAmount; }
+};
+
+// What a filtered read touched
+struct ColumnarScan {
+    uint32_t groups;        // row groups in the file
+    uint32_t groupsSkipped; // ruled out by their min/max statistics
+    uint64_t rowsDecoded;
+    ColumnarOrder order;
+
+    ColumnarScan() : groups(0), groupsSkipped(0), rowsDecoded(0), order(eORDER_NONE) {}
+};
+
+/**
+ * Write bids as a columnar file (through a temp file + rename, so readers
+ * never map a half-written file)
+ *
+ * @param order the order bids are in, recorded for readers
+ * @throws csv::Error on I/O failure
+ */
+void writeColumnar(const std::string &path, const BidList &bids, ColumnarOrder order,
+                   std::size_t rowGroupSize = 4096);
+
+// true when path is a regular file starting with the columnar magic (CSV files never do)
+bool isColumnarFile(const std::string &path);
+
+/**
+ * mmap a columnar file and decode the rows that pass filter
+ *
+ * @throws csv::Error when the file is missing, truncated or corrupt
+ */
+std::vector<Bid> readColumnar(const std::string &path, const ColumnarFilter &filter = ColumnarFilter(),
+                              ColumnarScan *scan = NULL);
+
+#endif /*!_COLUMNAR_HPP_*/
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef VECTOR_SORT_HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef VECTOR_SORT_HAVE_ZSTD
+# include <zstd.h>
+#endif
+#include "Decompress.hpp"
+#include "Instrumentation.hpp"
+
+namespace csv {
+
+  namespace {
+    // One aligned block is enough to sniff any magic number and keeps
+    // O_DIRECT reads behind it aligned
+    const std::size_t kPrefixSize = 64 * 1024;
+    const std::size_t kAlignment = 4096;
+
+    // compressed bytes pulled from the file per refill
+    const std::size_t kInputChunk = 256 * 1024;
+
+#ifdef VECTOR_SORT_HAVE_ZLIB
+    /*
+    ** gzip (and zlib) members, including concatenated members as written
+    ** by "cat a.gz b.gz" or parallel compressors
+    */
+    class GzipSource : public ByteSource
+    {
+      public:
+        explicit GzipSource(std::unique_ptr<ByteSource> source)
+          : _source(std::move(source)), _input(kInputChunk), _done(false)
+        {
+            std::memset(&_stream, 0, sizeof(_stream));
+            // 15 window bits + 32: detect gzip or zlib headers automatically
+            if (inflateInit2(&_stream, 15 + 32) != Z_OK)
+                throw Error("can't initialize gzip decoder");
+        }
+
+        ~GzipSource(void)
+        {
+            inflateEnd(&_stream);
+        }
+
+        std::size_t read(char *buffer, std::size_t size)
+        {
+            VS_SCOPE(eDECOMPRESS);
+            _stream.next_out = reinterpret_cast<Bytef *>(buffer);
+            _stream.avail_out = static_cast<uInt>(size);
+
+            while (_stream.avail_out > 0 && !_done)
+            {
+                if (_stream.avail_in == 0 && !refill())
+                    throw Error("truncated gzip input");
+
+                int rc = inflate(&_stream, Z_NO_FLUSH);
+                if (rc == Z_STREAM_END)
+                {
+                    // another member may follow; anything else (e.g. zero
+                    // padding) is ignored like gzip -d does
+                    if (_stream.avail_in == 0 && !refill())
+                        _done = true;
+                    else if (*_stream.next_in == 0x1f)
+                        inflateReset(&_stream);
+                    else
+                        _done = true;
+                }
+                else if (rc != Z_OK && rc != Z_BUF_ERROR)
+                    throw Error(std::string("corrupt gzip input: ").append(_stream.msg ? _stream.msg : "inflate failed"));
+            }
+
+            std::size_t produced = size - _stream.avail_out;
+            VS_COUNT(eBYTES_INFLATED, produced);
+            return produced;
+        }
+
+      private:
+        bool refill(void)
+        {
+            std::size_t n = _source->read(&_input[0], _input.size());
+            _stream.next_in = reinterpret_cast<Bytef *>(&_input[0]);
+            _stream.avail_in = static_cast<uInt>(n);
+            return n > 0;
+        }
+
+        std::unique_ptr<ByteSource> _source;
+        std::vector<char> _input;
+        z_stream _stream;
+        bool _done;
+    };
+#endif
+
+#ifdef VECTOR_SORT_HAVE_ZSTD
+    /*
+    ** zstd frames (one or more)
+    */
+    class ZstdSource : public ByteSource
+    {
+      public:
+        explicit ZstdSource(std::unique_ptr<ByteSource> source)
+          : _source(std::move(source)), _input(ZSTD_DStreamInSize()), _stream(ZSTD_createDStream()),
+            _inEnd(0), _pos(0), _frameOpen(false), _eof(false)
+        {
+            if (_stream == NULL)
+                throw Error("can't initialize zstd decoder");
+            ZSTD_initDStream(_stream);
+        }
+
+        ~ZstdSource(void)
+        {
+            ZSTD_freeDStream(_stream);
+        }
+
+        std::size_t read(char *buffer, std::size_t size)
+        {
+            VS_SCOPE(eDECOMPRESS);
+            ZSTD_outBuffer out = { buffer, size, 0 };
+
+            while (out.pos < out.size)
+            {
+                if (_pos == _inEnd)
+                {
+                    if (_eof)
+                        break;
+                    _inEnd = _source->read(&_input[0], _input.size());
+                    _pos = 0;
+                    if (_inEnd == 0)
+                    {
+                        _eof = true;
+                        if (_frameOpen)
+                            throw Error("truncated zstd input");
+                        break;
+                    }
+                }
+
+                ZSTD_inBuffer in = { &_input[0], _inEnd, _pos };
+                std::size_t rc = ZSTD_decompressStream(_stream, &out, &in);
+                if (ZSTD_isError(rc))
+                    throw Error(std::string("corrupt zstd input: ").append(ZSTD_getErrorName(rc)));
+                _pos = in.pos;
+                // rc == 0: a frame just ended cleanly
+                _frameOpen = rc != 0;
+            }
+
+            VS_COUNT(eBYTES_INFLATED, out.pos);
+            return out.pos;
+        }
+
+      private:
+        std::unique_ptr<ByteSource> _source;
+        std::vector<char> _input;
+        ZSTD_DStream *_stream;
+        std::size_t _inEnd;
+        std::size_t _pos;
+        bool _frameOpen;
+        bool _eof;
+    };
+#endif
+  }
+
+  const char *compressionName(Compression compression)
+  {
+      switch (compression)
+      {
+          case eGZIP: return "gzip";
+          case eZSTD: return "zstd";
+          default: return "none";
+      }
+  }
+
+  Compression detectCompression(const unsigned char *data, std::size_t size)
+  {
+      if (size >= 2 && data[0] == 0x1f && data[1] == 0x8b)
+          return eGZIP;
+      if (size >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd)
+          return eZSTD;
+      return eNONE;
+  }
+
+  /*
+  ** PREFIX SOURCE
+  */
+
+  PrefixSource::PrefixSource(std::unique_ptr<ByteSource> source)
+    : _source(std::move(source)), _prefix(NULL), _size(0), _offset(0)
+  {
+      void *mem = NULL;
+      if (posix_memalign(&mem, kAlignment, kPrefixSize) != 0)
+          throw Error("can't allocate read buffer");
+      _prefix = static_cast<char *>(mem);
+      try
+      {
+          _size = _source->read(_prefix, kPrefixSize);
+      }
+      catch (...)
+      {
+          std::free(_prefix);
+          throw;
+      }
+  }
+
+  PrefixSource::~PrefixSource(void)
+  {
+      std::free(_prefix);
+  }
+
+  const unsigned char *PrefixSource::prefix(void) const
+  {
+      return reinterpret_cast<const unsigned char *>(_prefix);
+  }
+
+  std::size_t PrefixSource::prefixSize(void) const
+  {
+      return _size;
+  }
+
+  std::size_t PrefixSource::read(char *buffer, std::size_t size)
+  {
+      std::size_t copied = 0;
+      if (_offset < _size)
+      {
+          copied = std::min(size, _size - _offset);
+          std::memcpy(buffer, _prefix + _offset, copied);
+          _offset += copied;
+      }
+      // a short prefix means the source already hit end of input
+      if (copied < size && _size == kPrefixSize)
+          copied += _source->read(buffer + copied, size - copied);
+      return copied;
+  }
+
+  std::unique_ptr<ByteSource> openDecompressed(std::unique_ptr<ByteSource> source, Compression *detected)
+  {
+      std::unique_ptr<PrefixSource> sniffed(new PrefixSource(std::move(source)));
+      Compression compression = detectCompression(sniffed->prefix(), sniffed->prefixSize());
+      if (detected)
+          *detected = compression;
+
+      switch (compression)
+      {
+          case eGZIP:
+#ifdef VECTOR_SORT_HAVE_ZLIB
+              return std::unique_ptr<ByteSource>(new GzipSource(std::move(sniffed)));
+#else
+              throw Error("gzip input detected but this build has no zlib support");
+#endif
+          case eZSTD:
+#ifdef VECTOR_SORT_HAVE_ZSTD
+              return std::unique_ptr<ByteSource>(new ZstdSource(std::move(sniffed)));
+#else
+              throw Error("zstd input detected but this build has no zstd support");
+#endif
+          default:
+              return std::unique_ptr<ByteSource>(std::move(sniffed));
+      }
+  }
+}
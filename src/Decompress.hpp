@@ -0,0 +1,56 @@
+#ifndef     _DECOMPRESS_HPP_
+# define    _DECOMPRESS_HPP_
+
+# include <cstddef>
+# include <memory>
+# include "AsyncReader.hpp"
+
+namespace csv
+{
+    enum Compression {
+        eNONE = 0,
+        eGZIP = 1,  // 1f 8b
+        eZSTD = 2   // 28 b5 2f fd
+    };
+
+    // Name for messages ("none", "gzip", "zstd")
+    const char *compressionName(Compression compression);
+
+    // Look at the first bytes of a stream
+    Compression detectCompression(const unsigned char *data, std::size_t size);
+
+    /*
+    ** Replays the bytes already consumed for magic detection, then reads
+    ** through to the wrapped source
+    */
+    class PrefixSource : public ByteSource
+    {
+      public:
+        explicit PrefixSource(std::unique_ptr<ByteSource> source);
+        ~PrefixSource(void);
+
+        // bytes available for sniffing (up to one block)
+        const unsigned char *prefix(void) const;
+        std::size_t prefixSize(void) const;
+
+        std::size_t read(char *buffer, std::size_t size);
+
+      private:
+        PrefixSource(const PrefixSource &);
+        PrefixSource &operator=(const PrefixSource &);
+
+        std::unique_ptr<ByteSource> _source;
+        char *_prefix;
+        std::size_t _size;
+        std::size_t _offset;
+    };
+
+    // Wrap source in the matching streaming decompressor (or return it as
+    // is) based on its magic bytes. The decompressor inflates straight into
+    // the caller's buffer; under an AsyncReader it runs on the reader thread,
+    // pipelined with parsing. Throws Error when the format was not compiled in.
+    std::unique_ptr<ByteSource> openDecompressed(std::unique_ptr<ByteSource> source,
+                                                 Compression *detected = NULL);
+}
+
+#endif /*!_DECOMPRESS_HPP_*/
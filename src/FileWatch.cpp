@@ -0,0 +1,152 @@
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <sys/inotify.h>
+#endif
+#include "FileWatch.hpp"
+
+namespace {
+    // how often the fallback re-stats the file
+    const int kPollSliceMs = 250;
+#if defined(__linux__)
+    // appends, truncation and rotation (rename/delete of the watched file)
+    const uint32_t kWatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+#endif
+}
+
+FileWatch::FileWatch(const std::string &path)
+    : _path(path), _fd(-1), _watch(-1), _size(0), _mtime(0) {
+#if defined(__linux__)
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd >= 0) {
+        _watch = inotify_add_watch(_fd, _path.c_str(), kWatchMask);
+        if (_watch < 0) {
+            // e.g. out of watches: fall back to polling
+            close(_fd);
+            _fd = -1;
+        }
+    }
+#endif
+    statChanged(); // remember the starting size/mtime
+}
+
+FileWatch::~FileWatch() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool FileWatch::native() const {
+    return _fd >= 0;
+}
+
+bool FileWatch::statChanged() {
+    struct stat st;
+    if (stat(_path.c_str(), &st) != 0) {
+        // gone (mid-rotation): report once, then wait for it to come back
+        bool changed = _size != 0 || _mtime != 0;
+        _size = 0;
+        _mtime = 0;
+        return changed;
+    }
+    bool changed = st.st_size != _size || st.st_mtime != _mtime;
+    _size = st.st_size;
+    _mtime = st.st_mtime;
+    return changed;
+}
+
+int FileWatch::wait(int timeoutMs, int inputFd) {
+    int waited = 0;
+    while (true) {
+        struct pollfd fds[2];
+        nfds_t count = 0;
+        if (_fd >= 0) {
+            fds[count].fd = _fd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            count++;
+        }
+        if (inputFd >= 0) {
+            fds[count].fd = inputFd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            count++;
+        }
+
+        int slice = timeoutMs;
+        if (_fd < 0) {
+            // polling: wake up every slice to re-stat
+            int left = timeoutMs < 0 ? kPollSliceMs : timeoutMs - waited;
+            slice = left < kPollSliceMs ? left : kPollSliceMs;
+        }
+
+        int ready = poll(fds, count, slice);
+        if (ready < 0 && errno != EINTR) {
+            return eWATCH_TIMEOUT;
+        }
+
+        int events = eWATCH_TIMEOUT;
+        if (ready > 0) {
+            for (nfds_t i = 0; i < count; i++) {
+                if (fds[i].revents == 0) {
+                    continue;
+                }
+                if (fds[i].fd == inputFd) {
+                    events |= eWATCH_INPUT;
+                } else {
+                    events |= eWATCH_CHANGED;
+                }
+            }
+        }
+
+#if defined(__linux__)
+        if (events & eWATCH_CHANGED) {
+            // drain the queue; a moved/deleted file is re-watched by path so
+            // a replaced file keeps being followed
+            alignas(struct inotify_event) char buffer[4096];
+            bool rewatch = false;
+            ssize_t n;
+            while ((n = read(_fd, buffer, sizeof(buffer))) > 0) {
+                for (char *p = buffer; p < buffer + n;) {
+                    const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+                    if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+                        rewatch = true;
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            if (rewatch) {
+                inotify_rm_watch(_fd, _watch);
+                _watch = inotify_add_watch(_fd, _path.c_str(), kWatchMask);
+                if (_watch < 0) {
+                    // not recreated yet: poll until it is
+                    close(_fd);
+                    _fd = -1;
+                    statChanged();
+                }
+            }
+        }
+#endif
+        if (_fd < 0 && statChanged()) {
+            events |= eWATCH_CHANGED;
+        }
+        if (events != eWATCH_TIMEOUT) {
+            return events;
+        }
+
+        if (_fd >= 0) {
+            // inotify slept the whole timeout (or was interrupted)
+            if (ready == 0) {
+                return eWATCH_TIMEOUT;
+            }
+            continue;
+        }
+        waited += slice;
+        if (timeoutMs >= 0 && waited >= timeoutMs) {
+            return eWATCH_TIMEOUT;
+        }
+    }
+}
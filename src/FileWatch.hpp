@@ -0,0 +1,48 @@
+#ifndef     _FILEWATCH_HPP_
+# define    _FILEWATCH_HPP_
+
+# include <string>
+# include <sys/types.h>
+
+// What FileWatch::wait() saw (bit flags)
+enum WatchEvent {
+    eWATCH_TIMEOUT = 0,
+    eWATCH_CHANGED = 1, // the file was written, truncated or replaced
+    eWATCH_INPUT = 2    // the extra descriptor (e.g. stdin) is readable
+};
+
+/**
+ * Wakes up when a file is modified: inotify on Linux, a size/mtime poll
+ * elsewhere. Used by the live tail so an idle file costs nothing.
+ */
+class FileWatch {
+public:
+    explicit FileWatch(const std::string &path);
+    ~FileWatch();
+
+    /**
+     * Block until the file changes, inputFd becomes readable or timeoutMs
+     * passes (-1 = no timeout)
+     *
+     * @return eWATCH_* flags
+     */
+    int wait(int timeoutMs, int inputFd = -1);
+
+    // true when inotify is in use (false = polling fallback)
+    bool native() const;
+
+private:
+    FileWatch(const FileWatch &);
+    FileWatch &operator=(const FileWatch &);
+
+    // poll fallback: has the file's size or mtime moved since last time?
+    bool statChanged();
+
+    const std::string _path;
+    int _fd;    // inotify descriptor, -1 when polling
+    int _watch; // inotify watch descriptor
+    off_t _size;
+    time_t _mtime;
+};
+
+#endif /*!_FILEWATCH_HPP_*/
@@ -0,0 +1,223 @@
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include "Instrumentation.hpp"
+#include "MemoryBudget.hpp"
+
+namespace instr {
+
+  namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    // One complete ("ph":"X") trace event
+    struct TraceEvent {
+        Phase phase;
+        unsigned int tid;
+        std::int64_t startNs;
+        std::int64_t durNs;
+    };
+
+    // Keep a long session from eating all memory; further events are dropped
+    const std::size_t kMaxTraceEvents = 1 << 20;
+
+    std::atomic<std::uint64_t> g_phaseNs[ePHASE_COUNT];
+    std::atomic<std::uint64_t> g_phaseCalls[ePHASE_COUNT];
+    std::atomic<std::uint64_t> g_counters[eCOUNTER_COUNT];
+
+    std::atomic<bool> g_traceOn(false);
+    std::atomic<std::uint64_t> g_traceDropped(0);
+    std::mutex g_traceLock;
+    std::vector<TraceEvent> g_trace;
+
+    // trace timestamps are relative to the first time anything is recorded
+    const Clock::time_point g_epoch = Clock::now();
+
+    unsigned int threadId(void)
+    {
+        static std::atomic<unsigned int> next(1);
+        thread_local unsigned int id = next.fetch_add(1);
+        return id;
+    }
+
+    const char *const kPhaseNames[ePHASE_COUNT] = {
+        "load", "io", "io_wait", "decompress", "tokenize", "row_alloc", "convert", "sort", "partition", "encode", "merge", "export", "render"
+    };
+
+    const char *const kCounterNames[eCOUNTER_COUNT] = {
+        "comparisons", "swaps", "bytes_read", "bytes_inflated", "allocations", "rows", "key_ties", "duplicates", "runs"
+    };
+  }
+
+  bool enabled(void)
+  {
+#ifdef VECTOR_SORT_INSTRUMENT
+      return true;
+#else
+      return false;
+#endif
+  }
+
+  const char *phaseName(Phase phase)
+  {
+      return kPhaseNames[phase];
+  }
+
+  const char *counterName(Counter counter)
+  {
+      return kCounterNames[counter];
+  }
+
+  void record(Phase phase, Clock::time_point start, Clock::time_point end)
+  {
+      std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+      recordTotal(phase, start, static_cast<std::uint64_t>(ns), 1);
+  }
+
+  void recordTotal(Phase phase, Clock::time_point start, std::uint64_t ns, std::uint64_t calls)
+  {
+      g_phaseNs[phase].fetch_add(ns, std::memory_order_relaxed);
+      g_phaseCalls[phase].fetch_add(calls, std::memory_order_relaxed);
+
+      if (g_traceOn.load(std::memory_order_relaxed))
+      {
+          TraceEvent ev;
+          ev.phase = phase;
+          ev.tid = threadId();
+          ev.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(start - g_epoch).count();
+          ev.durNs = static_cast<std::int64_t>(ns);
+
+          std::lock_guard<std::mutex> lock(g_traceLock);
+          if (g_trace.size() < kMaxTraceEvents)
+              g_trace.push_back(ev);
+          else
+              g_traceDropped.fetch_add(1, std::memory_order_relaxed);
+      }
+  }
+
+  void add(Counter counter, std::uint64_t n)
+  {
+      g_counters[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  std::uint64_t count(Counter counter)
+  {
+      return g_counters[counter].load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t phaseCalls(Phase phase)
+  {
+      return g_phaseCalls[phase].load(std::memory_order_relaxed);
+  }
+
+  double phaseSeconds(Phase phase)
+  {
+      return g_phaseNs[phase].load(std::memory_order_relaxed) / 1e9;
+  }
+
+  void reset(void)
+  {
+      for (int i = 0; i < ePHASE_COUNT; i++)
+      {
+          g_phaseNs[i].store(0);
+          g_phaseCalls[i].store(0);
+      }
+      for (int i = 0; i < eCOUNTER_COUNT; i++)
+          g_counters[i].store(0);
+
+      std::lock_guard<std::mutex> lock(g_traceLock);
+      g_trace.clear();
+      g_traceDropped.store(0);
+  }
+
+  void enableTrace(bool on)
+  {
+      g_traceOn.store(on);
+  }
+
+  void printReport(std::ostream &os)
+  {
+      if (!enabled())
+      {
+          os << "Instrumentation was compiled out (configure with -DVECTOR_SORT_INSTRUMENT=ON)." << std::endl;
+          return;
+      }
+
+      std::ios::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+
+      os << std::left << std::setw(14) << "Phase"
+         << std::right << std::setw(12) << "Calls"
+         << std::setw(16) << "Total (us)"
+         << std::setw(14) << "Avg (us)" << "\n";
+      for (int i = 0; i < ePHASE_COUNT; i++)
+      {
+          Phase p = static_cast<Phase>(i);
+          std::uint64_t calls = phaseCalls(p);
+          double us = phaseSeconds(p) * 1e6;
+          os << std::left << std::setw(14) << phaseName(p)
+             << std::right << std::setw(12) << calls
+             << std::setw(16) << std::fixed << std::setprecision(1) << us
+             << std::setw(14) << std::setprecision(3) << (calls ? us / calls : 0.0) << "\n";
+      }
+
+      os << "\n" << std::left << std::setw(14) << "Counter"
+         << std::right << std::setw(16) << "Value" << "\n";
+      for (int i = 0; i < eCOUNTER_COUNT; i++)
+      {
+          Counter c = static_cast<Counter>(i);
+          os << std::left << std::setw(14) << counterName(c)
+             << std::right << std::setw(16) << count(c) << "\n";
+      }
+      os << "(phase totals are inclusive: partition time is also part of sort)" << std::endl;
+
+      os.flags(flags);
+      os.precision(precision);
+  }
+
+  void writeJson(std::ostream &os)
+  {
+      os << "{\n  \"instrumentation\": " << (enabled() ? "true" : "false") << ",\n";
+      os << "  \"phases\": {";
+      for (int i = 0; i < ePHASE_COUNT; i++)
+      {
+          Phase p = static_cast<Phase>(i);
+          os << (i ? ",\n" : "\n") << "    \"" << phaseName(p) << "\": {\"calls\": " << phaseCalls(p)
+             << ", \"total_ns\": " << g_phaseNs[i].load(std::memory_order_relaxed) << "}";
+      }
+      os << "\n  },\n  \"counters\": {";
+      for (int i = 0; i < eCOUNTER_COUNT; i++)
+      {
+          Counter c = static_cast<Counter>(i);
+          os << (i ? ",\n" : "\n") << "    \"" << counterName(c) << "\": " << count(c);
+      }
+      // memory is accounted even when the probes are compiled out
+      os << "\n  },\n  \"memory\": ";
+      mem::writeJson(os, "  ");
+      os << "\n}" << std::endl;
+  }
+
+  bool writeTrace(const std::string &path)
+  {
+      std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+      if (!out.is_open())
+          return false;
+
+      std::lock_guard<std::mutex> lock(g_traceLock);
+      // trace-event timestamps are microseconds; keep the sub-microsecond part
+      out << std::fixed << std::setprecision(3);
+      out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":"
+          << g_traceDropped.load() << "},\"traceEvents\":[";
+      for (std::size_t i = 0; i < g_trace.size(); i++)
+      {
+          const TraceEvent &ev = g_trace[i];
+          out << (i ? ",\n" : "\n")
+              << "{\"name\":\"" << phaseName(ev.phase) << "\",\"cat\":\"vector_sort\",\"ph\":\"X\""
+              << ",\"ts\":" << ev.startNs / 1000.0 << ",\"dur\":" << ev.durNs / 1000.0
+              << ",\"pid\":1,\"tid\":" << ev.tid << "}";
+      }
+      out << "\n]}" << std::endl;
+      return out.good();
+  }
+}
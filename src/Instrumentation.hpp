@@ -0,0 +1,180 @@
+#ifndef     _INSTRUMENTATION_HPP_
+# define    _INSTRUMENTATION_HPP_
+
+# include <atomic>
+# include <chrono>
+# include <cstdint>
+# include <ostream>
+# include <string>
+
+//============================================================================
+// Hot-path instrumentation: scoped phase timers and event counters.
+//
+// Everything is reached through the VS_* macros below so a build configured
+// with -DVECTOR_SORT_INSTRUMENT=OFF compiles every probe down to nothing.
+// The report/JSON/trace functions stay available either way and simply say
+// that instrumentation was compiled out.
+//============================================================================
+
+namespace instr
+{
+    // Timed phases. Phases may nest (a partition runs inside a sort), so
+    // totals are inclusive of any phase opened inside them.
+    enum Phase {
+        eLOAD = 0,      // whole loadBids() call
+        eIO,            // reading bytes from disk (reader thread)
+        eIO_WAIT,       // parser waiting for the reader to fill a buffer
+        eDECOMPRESS,    // inflating gzip/zstd input (reader thread)
+        eTOKENIZE,      // splitting lines into fields
+        eROW_ALLOC,     // allocating csv::Row objects (tallied per chunk)
+        eCONVERT,       // converting rows to bids (tallied per batch)
+        eSORT,          // whole sort call
+        ePARTITION,     // quick sort partition passes
+        eENCODE,        // building normalized sort keys
+        eMERGE,         // merging / de-duplicating multi-file loads
+        eEXPORT,        // writing columnar files
+        eRENDER,        // formatting and writing bids to the terminal
+        ePHASE_COUNT
+    };
+
+    // Plain event counters.
+    enum Counter {
+        eCOMPARISONS = 0,
+        eSWAPS,
+        eBYTES_READ,
+        eBYTES_INFLATED, // decompressed bytes handed to the parser
+        eALLOCATIONS,
+        eROWS,
+        eKEY_TIES,      // normalized key prefixes that tied (full key compared)
+        eDUPLICATES,    // bids dropped as duplicate bidIds
+        eRUNS,          // natural runs found by the adaptive sort
+        eCOUNTER_COUNT
+    };
+
+    // true when the probes were compiled in
+    bool enabled(void);
+
+    const char *phaseName(Phase phase);
+    const char *counterName(Counter counter);
+
+    // Accumulate a finished interval for a phase (used by ScopedTimer)
+    void record(Phase phase, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+
+    // Accumulate calls intervals of a phase totalling ns, the first of them
+    // starting at start, as one trace event (used by PhaseTally)
+    void recordTotal(Phase phase, std::chrono::steady_clock::time_point start,
+                     std::uint64_t ns, std::uint64_t calls);
+
+    // Add n to a counter; relaxed atomics so loader threads can share them
+    void add(Counter counter, std::uint64_t n);
+
+    std::uint64_t count(Counter counter);
+    std::uint64_t phaseCalls(Phase phase);
+    double phaseSeconds(Phase phase);
+
+    // Clear all phase totals, counters and buffered trace events
+    void reset(void);
+
+    // Turn on buffering of Chrome trace events (off by default: it costs a
+    // lock per timed scope)
+    void enableTrace(bool on);
+
+    // Breakdown table for the terminal
+    void printReport(std::ostream &os);
+    // Same data as a JSON object (plus the mem:: pools, see MemoryBudget.hpp)
+    void writeJson(std::ostream &os);
+    // Chrome trace-event file (load in chrome://tracing or Perfetto)
+    bool writeTrace(const std::string &path);
+
+    // RAII timer: records the time between construction and destruction
+    class ScopedTimer
+    {
+      public:
+        explicit ScopedTimer(Phase phase)
+          : _phase(phase), _start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer(void) { record(_phase, _start, std::chrono::steady_clock::now()); }
+
+      private:
+        ScopedTimer(const ScopedTimer &);
+        ScopedTimer &operator=(const ScopedTimer &);
+
+        const Phase _phase;
+        const std::chrono::steady_clock::time_point _start;
+    };
+
+    // Per-row intervals of one phase summed locally; flush() records them
+    // as one entry, so a load adds a trace event per chunk, not per row
+    class PhaseTally
+    {
+      public:
+        explicit PhaseTally(Phase phase) : _phase(phase), _ns(0), _calls(0) {}
+        ~PhaseTally(void) { flush(); }
+
+        void add(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+        {
+            if (_calls == 0)
+                _first = start;
+            _ns += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            _calls++;
+        }
+
+        void flush(void)
+        {
+            if (_calls == 0)
+                return;
+            recordTotal(_phase, _first, _ns, _calls);
+            _ns = 0;
+            _calls = 0;
+        }
+
+      private:
+        PhaseTally(const PhaseTally &);
+        PhaseTally &operator=(const PhaseTally &);
+
+        const Phase _phase;
+        std::chrono::steady_clock::time_point _first;
+        std::uint64_t _ns;
+        std::uint64_t _calls;
+    };
+
+    // RAII interval timed into a PhaseTally
+    class TallyTimer
+    {
+      public:
+        explicit TallyTimer(PhaseTally &tally)
+          : _tally(tally), _start(std::chrono::steady_clock::now()) {}
+        ~TallyTimer(void) { _tally.add(_start, std::chrono::steady_clock::now()); }
+
+      private:
+        TallyTimer(const TallyTimer &);
+        TallyTimer &operator=(const TallyTimer &);
+
+        PhaseTally &_tally;
+        const std::chrono::steady_clock::time_point _start;
+    };
+}
+
+# define VS_CAT_(a, b) a##b
+# define VS_CAT(a, b) VS_CAT_(a, b)
+
+# ifdef VECTOR_SORT_INSTRUMENT
+// Time the rest of the enclosing scope under the given instr::Phase
+#  define VS_SCOPE(phase) instr::ScopedTimer VS_CAT(_vsScope, __LINE__)(instr::phase)
+// Add n to the given instr::Counter
+#  define VS_COUNT(counter, n) instr::add(instr::counter, (n))
+// Bump a local tally; hot loops count locally and VS_COUNT once at the end
+#  define VS_TALLY(var) (++(var))
+// Time the rest of the enclosing scope into an instr::PhaseTally (per-row
+// work), and record what it summed up (once per chunk or call)
+#  define VS_SCOPE_INTO(tally) instr::TallyTimer VS_CAT(_vsTally, __LINE__)(tally)
+#  define VS_FLUSH(tally) (tally).flush()
+# else
+#  define VS_SCOPE(phase) ((void)0)
+#  define VS_COUNT(counter, n) ((void)(n))
+#  define VS_TALLY(var) ((void)0)
+#  define VS_SCOPE_INTO(tally) ((void)0)
+#  define VS_FLUSH(tally) ((void)0)
+# endif
+
+#endif /*!_INSTRUMENTATION_HPP_*/
@@ -0,0 +1,205 @@
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include "MemoryBudget.hpp"
+
+namespace mem {
+
+  namespace {
+
+    std::atomic<std::size_t> g_current[ePOOL_COUNT];
+    std::atomic<std::size_t> g_peak[ePOOL_COUNT];
+    std::atomic<std::size_t> g_total(0);
+    std::atomic<std::size_t> g_peakTotal(0);
+    std::atomic<std::size_t> g_budget(0);
+
+    const char *const kPoolNames[ePOOL_COUNT] = {
+        "text", "rows", "bids", "sort"
+    };
+
+    void raisePeak(std::atomic<std::size_t> &peak, std::size_t value)
+    {
+        std::size_t seen = peak.load(std::memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+            ;
+    }
+
+    // a release larger than what is held (estimates drift) clamps at zero
+    void drop(std::atomic<std::size_t> &counter, std::size_t bytes)
+    {
+        std::size_t seen = counter.load(std::memory_order_relaxed);
+        while (!counter.compare_exchange_weak(seen, seen > bytes ? seen - bytes : 0, std::memory_order_relaxed))
+            ;
+    }
+  }
+
+  const char *poolName(Pool pool)
+  {
+      return kPoolNames[pool];
+  }
+
+  void charge(Pool pool, std::size_t bytes)
+  {
+      if (bytes == 0)
+          return;
+      raisePeak(g_peak[pool], g_current[pool].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+      raisePeak(g_peakTotal, g_total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+  }
+
+  void release(Pool pool, std::size_t bytes)
+  {
+      if (bytes == 0)
+          return;
+      drop(g_current[pool], bytes);
+      drop(g_total, bytes);
+  }
+
+  std::size_t current(Pool pool)
+  {
+      return g_current[pool].load(std::memory_order_relaxed);
+  }
+
+  std::size_t peak(Pool pool)
+  {
+      return g_peak[pool].load(std::memory_order_relaxed);
+  }
+
+  std::size_t total(void)
+  {
+      return g_total.load(std::memory_order_relaxed);
+  }
+
+  std::size_t peakTotal(void)
+  {
+      return g_peakTotal.load(std::memory_order_relaxed);
+  }
+
+  void setBudget(std::size_t bytes)
+  {
+      g_budget.store(bytes);
+  }
+
+  std::size_t budget(void)
+  {
+      return g_budget.load(std::memory_order_relaxed);
+  }
+
+  bool fits(std::size_t bytes)
+  {
+      std::size_t limit = budget();
+      std::size_t used = total();
+      return limit == 0 || (used <= limit && bytes <= limit - used);
+  }
+
+  std::size_t headroom(void)
+  {
+      std::size_t limit = budget();
+      std::size_t used = total();
+      return used < limit ? limit - used : 0;
+  }
+
+  bool overBudget(void)
+  {
+      std::size_t limit = budget();
+      return limit != 0 && total() > limit;
+  }
+
+  void resetPeaks(void)
+  {
+      for (int i = 0; i < ePOOL_COUNT; i++)
+          g_peak[i].store(g_current[i].load());
+      g_peakTotal.store(g_total.load());
+  }
+
+  std::string formatBytes(std::size_t bytes)
+  {
+      static const char *const units[] = { "KB", "MB", "GB", "TB" };
+      if (bytes < 1024)
+          return std::to_string(bytes) + " B";
+      double value = bytes / 1024.0;
+      int unit = 0;
+      while (value >= 1024.0 && unit < 3)
+      {
+          value /= 1024.0;
+          unit++;
+      }
+      char text[32];
+      std::snprintf(text, sizeof(text), "%.1f %s", value, units[unit]);
+      return text;
+  }
+
+  std::size_t parseBytes(const std::string &text)
+  {
+      char *end = NULL;
+      double value = std::strtod(text.c_str(), &end);
+      if (end == text.c_str() || !(value > 0))
+          return 0;
+      std::string suffix(end);
+      if (!suffix.empty() && (suffix[suffix.size() - 1] == 'B' || suffix[suffix.size() - 1] == 'b'))
+          suffix.erase(suffix.size() - 1);
+      double scale = 1;
+      if (suffix.size() == 1)
+      {
+          switch (std::toupper(static_cast<unsigned char>(suffix[0])))
+          {
+              case 'K': scale = 1024.0; break;
+              case 'M': scale = 1024.0 * 1024; break;
+              case 'G': scale = 1024.0 * 1024 * 1024; break;
+              case 'T': scale = 1024.0 * 1024 * 1024 * 1024; break;
+              default: return 0;
+          }
+      }
+      else if (!suffix.empty())
+          return 0;
+      return static_cast<std::size_t>(value * scale);
+  }
+
+  std::string usage(void)
+  {
+      std::string out;
+      for (int i = 0; i < ePOOL_COUNT; i++)
+      {
+          Pool p = static_cast<Pool>(i);
+          out.append(i ? ", " : "").append(poolName(p)).append(" ").append(formatBytes(current(p)));
+      }
+      return out;
+  }
+
+  void printReport(std::ostream &os)
+  {
+      std::ios::fmtflags flags = os.flags();
+
+      os << std::left << std::setw(14) << "Memory"
+         << std::right << std::setw(16) << "Current"
+         << std::setw(16) << "Peak" << "\n";
+      for (int i = 0; i < ePOOL_COUNT; i++)
+      {
+          Pool p = static_cast<Pool>(i);
+          os << std::left << std::setw(14) << poolName(p)
+             << std::right << std::setw(16) << formatBytes(current(p))
+             << std::setw(16) << formatBytes(peak(p)) << "\n";
+      }
+      os << std::left << std::setw(14) << "total"
+         << std::right << std::setw(16) << formatBytes(total())
+         << std::setw(16) << formatBytes(peakTotal()) << "\n";
+      os << "(budget: " << (budget() ? formatBytes(budget()) : std::string("none"))
+         << "; peaks are per pool, the total peak is the highest sum at any one time)" << std::endl;
+
+      os.flags(flags);
+  }
+
+  void writeJson(std::ostream &os, const std::string &indent)
+  {
+      os << "{\n" << indent << "  \"budget_bytes\": " << budget();
+      for (int i = 0; i <= ePOOL_COUNT; i++)
+      {
+          Pool p = static_cast<Pool>(i);
+          bool all = i == ePOOL_COUNT;
+          os << ",\n" << indent << "  \"" << (all ? "total" : poolName(p)) << "\": {\"current_bytes\": "
+             << (all ? total() : current(p)) << ", \"peak_bytes\": " << (all ? peakTotal() : peak(p)) << "}";
+      }
+      os << "\n" << indent << "}";
+  }
+}
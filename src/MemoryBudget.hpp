@@ -0,0 +1,99 @@
+#ifndef     _MEMORYBUDGET_HPP_
+# define    _MEMORYBUDGET_HPP_
+
+# include <cstddef>
+# include <ostream>
+# include <string>
+
+//============================================================================
+// Memory accounting and the optional memory budget (--memory-budget=).
+//
+// The big holders of memory charge what they allocate to a pool and release
+// it when they free it, so the current and peak bytes of each subsystem are
+// known at any time. Unlike the instr probes this is always compiled in: the
+// loaders consult it to pick a path that fits the budget, or to stop with an
+// estimate before the kernel's OOM killer stops the process for them.
+// Charges are estimates of heap bytes (object sizes, vector capacities and
+// string buffers), not malloc overhead.
+//============================================================================
+
+namespace mem
+{
+    enum Pool {
+        eTEXT = 0,  // raw input: read buffers in flight
+        eROWS,      // csv::Row objects (with their header copy and fields)
+        eBIDS,      // Bid records: loads in progress and published versions
+        eSORT,      // sort scratch: normalized keys, permutation and merge buffers
+        ePOOL_COUNT
+    };
+
+    const char *poolName(Pool pool);
+
+    // Relaxed atomics: loader threads charge concurrently
+    void charge(Pool pool, std::size_t bytes);
+    void release(Pool pool, std::size_t bytes);
+
+    std::size_t current(Pool pool);
+    std::size_t peak(Pool pool);
+    std::size_t total(void);
+    std::size_t peakTotal(void);
+
+    // 0 (the default) means no budget
+    void setBudget(std::size_t bytes);
+    std::size_t budget(void);
+
+    // whether bytes more would still be within the budget (always without one)
+    bool fits(std::size_t bytes);
+    // what is left of the budget (0 once it is used up; set a budget first)
+    std::size_t headroom(void);
+    bool overBudget(void);
+
+    // Forget the peaks (current charges stay, they are still held)
+    void resetPeaks(void);
+
+    // "512 B", "12.3 MB", ...
+    std::string formatBytes(std::size_t bytes);
+    // "512M", "2G", "64k" or plain bytes; 0 for anything else
+    std::size_t parseBytes(const std::string &text);
+    // "text 2.0 MB, rows 0 B, bids 61.2 MB, sort 0 B" (current charges)
+    std::string usage(void);
+
+    // Current / peak table for the terminal
+    void printReport(std::ostream &os);
+    // Same data as a JSON object, nested at indent
+    void writeJson(std::ostream &os, const std::string &indent);
+
+    // Heap buffer a string owns (0 while it fits the small-string buffer)
+    inline std::size_t heapBytes(const std::string &s)
+    {
+        static const std::size_t inlineCapacity = std::string().capacity();
+        return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+    }
+
+    // RAII charge that can grow and shrink with the buffer it stands for
+    class Reservation
+    {
+      public:
+        explicit Reservation(Pool pool, std::size_t bytes = 0) : _pool(pool), _bytes(0) { resize(bytes); }
+        ~Reservation(void) { resize(0); }
+
+        void resize(std::size_t bytes)
+        {
+            if (bytes > _bytes)
+                charge(_pool, bytes - _bytes);
+            else if (bytes < _bytes)
+                release(_pool, _bytes - bytes);
+            _bytes = bytes;
+        }
+        std::size_t size(void) const { return _bytes; }
+
+      private:
+        Reservation(const Reservation &);
+        Reservation &operator=(const Reservation &);
+
+        const Pool _pool;
+        std::size_t _bytes;
+    };
+}
+
+#endif /*!_MEMORYBUDGET_HPP_*/
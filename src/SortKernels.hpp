@@ -0,0 +1,1056 @@
+#ifndef     _SORTKERNELS_HPP_
+# define    _SORTKERNELS_HPP_
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <cstring>
+# include <functional>
+# include <iterator>
+# include <type_traits>
+# include <utility>
+# include <vector>
+# include "Instrumentation.hpp"
+# include "MemoryBudget.hpp"
+
+//============================================================================
+// Header-only sort kernels.
+//
+// Every engine is a template over the iterator, a key projection (what to
+// compare, e.g. a Bid's title) and a comparator. The kind of key picks the
+// compare/exchange implementation at compile time:
+//   - arithmetic keys with the default comparator use a plain '<' that the
+//     compiler turns into a conditional move (no data-dependent branch);
+//   - FixedPrefix<N> keys compare with one memcmp of N bytes;
+//   - anything else goes through the comparator.
+// Small ranges (<= 8 elements) are finished with size-specialized sorting
+// networks, slightly larger ones with insertion sort.
+//============================================================================
+
+namespace vsort
+{
+    // Projection that compares the elements themselves
+    struct Identity
+    {
+        template<typename T>
+        const T &operator()(const T &value) const { return value; }
+    };
+
+    // Default comparator ("a < b")
+    struct Less
+    {
+        template<typename A, typename B>
+        bool operator()(const A &a, const B &b) const { return a < b; }
+    };
+
+    // Fixed-width, order-preserving binary key (big-endian bytes).
+    // Compared with memcmp, so two keys are ordered by their first
+    // differing byte just like strings are.
+    template<std::size_t N>
+    struct FixedPrefix
+    {
+        unsigned char bytes[N];
+
+        bool operator<(const FixedPrefix &other) const
+        {
+            return std::memcmp(bytes, other.bytes, N) < 0;
+        }
+        bool operator==(const FixedPrefix &other) const
+        {
+            return std::memcmp(bytes, other.bytes, N) == 0;
+        }
+    };
+
+    // Ranges at or below this size skip partitioning and go to smallSort
+    const std::ptrdiff_t kSmallSortThreshold = 16;
+
+    // Elements classified per offset block by the block partition
+    const std::size_t kPartitionBlock = 64;
+
+    // Element moves a partial insertion sort may make before it gives up
+    const std::size_t kPartialInsertionLimit = 8;
+
+    // How quickSort splits a range
+    enum PartitionStrategy {
+        eHOARE = 0, // classic two-index Hoare loop, middle element pivot
+        eBLOCK = 1  // BlockQuicksort: branch-free classification into offset buffers
+    };
+
+    namespace detail
+    {
+        //--------------------------------------------------------------------
+        // Key classification (compile time)
+        //--------------------------------------------------------------------
+
+        struct GenericKey {};
+        struct ArithmeticKey {};
+        struct PrefixKey {};
+
+        template<typename T>
+        struct IsFixedPrefix : std::false_type {};
+        template<std::size_t N>
+        struct IsFixedPrefix<FixedPrefix<N> > : std::true_type {};
+
+        template<typename Key, typename Comp>
+        struct KeyKind
+        {
+            static constexpr bool arithmetic =
+                std::is_arithmetic<Key>::value && std::is_same<Comp, Less>::value;
+            static constexpr bool prefix =
+                IsFixedPrefix<Key>::value && std::is_same<Comp, Less>::value;
+
+            typedef typename std::conditional<arithmetic, ArithmeticKey,
+                    typename std::conditional<prefix, PrefixKey, GenericKey>::type>::type type;
+        };
+
+        template<typename It, typename Proj>
+        struct ProjectedKey
+        {
+            typedef typename std::decay<
+                decltype(std::declval<Proj &>()(*std::declval<It>()))>::type type;
+        };
+
+        template<typename Key, typename Comp>
+        inline bool keyLess(const Key &a, const Key &b, Comp &comp, GenericKey)
+        {
+            return comp(a, b);
+        }
+
+        template<typename Key, typename Comp>
+        inline bool keyLess(const Key &a, const Key &b, Comp &, ArithmeticKey)
+        {
+            // evaluates to a flag, no short-circuit: compiles to setcc/cmov
+            return a < b;
+        }
+
+        template<typename Key, typename Comp>
+        inline bool keyLess(const Key &a, const Key &b, Comp &, PrefixKey)
+        {
+            return std::memcmp(a.bytes, b.bytes, sizeof(a.bytes)) < 0;
+        }
+
+        //--------------------------------------------------------------------
+        // Per-call context: projection, comparator and instrumentation tallies
+        //--------------------------------------------------------------------
+
+        template<typename It, typename Proj, typename Comp>
+        class Context
+        {
+          public:
+            typedef typename ProjectedKey<It, Proj>::type Key;
+            typedef typename KeyKind<Key, Comp>::type Kind;
+            typedef typename std::iterator_traits<It>::value_type Value;
+
+            // Elements are their own arithmetic key: compare-exchange can
+            // use min/max selects instead of a conditional swap
+            static constexpr bool branchlessExchange =
+                std::is_same<Proj, Identity>::value && std::is_same<Kind, ArithmeticKey>::value;
+
+            Context(Proj p, Comp c) : proj(p), comp(c), comparisons(0), swaps(0) {}
+            ~Context(void)
+            {
+                VS_COUNT(eCOMPARISONS, comparisons);
+                VS_COUNT(eSWAPS, swaps);
+            }
+
+            bool keyLess(const Key &a, const Key &b)
+            {
+                VS_TALLY(comparisons);
+                return detail::keyLess(a, b, comp, Kind());
+            }
+
+            bool less(It a, It b)
+            {
+                return keyLess(proj(*a), proj(*b));
+            }
+
+            void swap(It a, It b)
+            {
+                VS_TALLY(swaps);
+                std::iter_swap(a, b);
+            }
+
+            // Order *a and *b
+            void exchange(It a, It b)
+            {
+                exchange(a, b, std::integral_constant<bool, branchlessExchange>());
+            }
+
+            Proj proj;
+            Comp comp;
+            std::uint64_t comparisons;
+            std::uint64_t swaps;
+
+          private:
+            void exchange(It a, It b, std::false_type)
+            {
+                if (less(b, a))
+                    swap(a, b);
+            }
+
+            void exchange(It a, It b, std::true_type)
+            {
+                VS_TALLY(comparisons);
+                Value x = *a;
+                Value y = *b;
+                bool flip = y < x;
+                *a = flip ? y : x;
+                *b = flip ? x : y;
+            }
+        };
+
+        //--------------------------------------------------------------------
+        // Sorting networks for 2..8 elements (optimal comparator counts)
+        //--------------------------------------------------------------------
+
+        template<std::size_t N>
+        struct Network;
+
+        template<>
+        struct Network<2>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c) { c.exchange(a, a + 1); }
+        };
+
+        template<>
+        struct Network<3>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c)
+            {
+                c.exchange(a + 0, a + 2); c.exchange(a + 0, a + 1); c.exchange(a + 1, a + 2);
+            }
+        };
+
+        template<>
+        struct Network<4>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c)
+            {
+                c.exchange(a + 0, a + 2); c.exchange(a + 1, a + 3);
+                c.exchange(a + 0, a + 1); c.exchange(a + 2, a + 3);
+                c.exchange(a + 1, a + 2);
+            }
+        };
+
+        template<>
+        struct Network<5>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c)
+            {
+                c.exchange(a + 0, a + 3); c.exchange(a + 1, a + 4);
+                c.exchange(a + 0, a + 2); c.exchange(a + 1, a + 3);
+                c.exchange(a + 0, a + 1); c.exchange(a + 2, a + 4);
+                c.exchange(a + 1, a + 2); c.exchange(a + 3, a + 4);
+                c.exchange(a + 2, a + 3);
+            }
+        };
+
+        template<>
+        struct Network<6>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c)
+            {
+                c.exchange(a + 0, a + 5); c.exchange(a + 1, a + 3); c.exchange(a + 2, a + 4);
+                c.exchange(a + 1, a + 2); c.exchange(a + 3, a + 4);
+                c.exchange(a + 0, a + 3); c.exchange(a + 2, a + 5);
+                c.exchange(a + 0, a + 1); c.exchange(a + 2, a + 3); c.exchange(a + 4, a + 5);
+                c.exchange(a + 1, a + 2); c.exchange(a + 3, a + 4);
+            }
+        };
+
+        template<>
+        struct Network<7>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c)
+            {
+                c.exchange(a + 0, a + 6); c.exchange(a + 2, a + 3); c.exchange(a + 4, a + 5);
+                c.exchange(a + 0, a + 2); c.exchange(a + 1, a + 4); c.exchange(a + 3, a + 6);
+                c.exchange(a + 0, a + 1); c.exchange(a + 2, a + 5); c.exchange(a + 3, a + 4);
+                c.exchange(a + 1, a + 2); c.exchange(a + 4, a + 6);
+                c.exchange(a + 2, a + 3); c.exchange(a + 4, a + 5);
+                c.exchange(a + 1, a + 2); c.exchange(a + 3, a + 4); c.exchange(a + 5, a + 6);
+            }
+        };
+
+        template<>
+        struct Network<8>
+        {
+            template<typename It, typename Ctx>
+            static void sort(It a, Ctx &c)
+            {
+                c.exchange(a + 0, a + 2); c.exchange(a + 1, a + 3);
+                c.exchange(a + 4, a + 6); c.exchange(a + 5, a + 7);
+                c.exchange(a + 0, a + 4); c.exchange(a + 1, a + 5);
+                c.exchange(a + 2, a + 6); c.exchange(a + 3, a + 7);
+                c.exchange(a + 0, a + 1); c.exchange(a + 2, a + 3);
+                c.exchange(a + 4, a + 5); c.exchange(a + 6, a + 7);
+                c.exchange(a + 2, a + 4); c.exchange(a + 3, a + 5);
+                c.exchange(a + 1, a + 4); c.exchange(a + 3, a + 6);
+                c.exchange(a + 1, a + 2); c.exchange(a + 3, a + 4); c.exchange(a + 5, a + 6);
+            }
+        };
+
+        //--------------------------------------------------------------------
+        // Engines (all work on the half-open range [first, last))
+        //--------------------------------------------------------------------
+
+        template<typename It, typename Ctx>
+        void insertionSort(It first, It last, Ctx &c)
+        {
+            if (first == last)
+                return;
+            for (It i = first + 1; i != last; ++i)
+            {
+                // shift the new element left until it is in place
+                for (It j = i; j != first && c.less(j, j - 1); --j)
+                    c.swap(j, j - 1);
+            }
+        }
+
+        // Insertion sort that gives up once it has moved elements more than
+        // kPartialInsertionLimit positions in total. Returns true when the
+        // range ended up sorted, so nearly sorted ranges cost about n compares.
+        template<typename It, typename Ctx>
+        bool partialInsertionSort(It first, It last, Ctx &c)
+        {
+            if (first == last)
+                return true;
+            std::size_t moves = 0;
+            for (It i = first + 1; i != last; ++i)
+            {
+                for (It j = i; j != first && c.less(j, j - 1); --j, ++moves)
+                    c.swap(j, j - 1);
+                if (moves > kPartialInsertionLimit)
+                    return false;
+            }
+            return true;
+        }
+
+        template<typename It, typename Ctx>
+        void sortSmallRange(It first, It last, Ctx &c)
+        {
+            switch (last - first)
+            {
+                case 0:
+                case 1: return;
+                case 2: Network<2>::sort(first, c); return;
+                case 3: Network<3>::sort(first, c); return;
+                case 4: Network<4>::sort(first, c); return;
+                case 5: Network<5>::sort(first, c); return;
+                case 6: Network<6>::sort(first, c); return;
+                case 7: Network<7>::sort(first, c); return;
+                case 8: Network<8>::sort(first, c); return;
+                default: insertionSort(first, last, c); return;
+            }
+        }
+
+        // Classic Hoare partition around the middle element's key.
+        // Returns the last position of the low part.
+        template<typename It, typename Ctx>
+        It hoarePartition(It first, It last, Ctx &c)
+        {
+            VS_SCOPE(ePARTITION);
+            It low = first;
+            It high = last - 1;
+
+            // copy: the pivot element itself may be swapped away during the pass
+            const typename Ctx::Key pivot = c.proj(*(first + (last - first - 1) / 2));
+
+            while (true)
+            {
+                while (c.keyLess(c.proj(*low), pivot))
+                    ++low;
+                while (c.keyLess(pivot, c.proj(*high)))
+                    --high;
+
+                if (low >= high)
+                    return high;
+
+                c.swap(low, high);
+                ++low;
+                --high;
+            }
+        }
+
+        template<typename It, typename Ctx>
+        void quickSortLoop(It first, It last, Ctx &c)
+        {
+            while (last - first > kSmallSortThreshold)
+            {
+                It mid = hoarePartition(first, last, c) + 1;
+
+                // recurse into the smaller side, loop on the larger one so
+                // the stack stays O(log n) even on bad pivots
+                if (mid - first < last - mid)
+                {
+                    quickSortLoop(first, mid, c);
+                    first = mid;
+                }
+                else
+                {
+                    quickSortLoop(mid, last, c);
+                    last = mid;
+                }
+            }
+            sortSmallRange(first, last, c);
+        }
+
+        // Put the median of first, middle and last - 1 at first
+        template<typename It, typename Ctx>
+        void medianToFront(It first, It last, Ctx &c)
+        {
+            It mid = first + (last - first) / 2;
+            c.exchange(mid, first);
+            c.exchange(first, last - 1);
+            c.exchange(mid, first);
+        }
+
+        // Block partition (Edelkamp & Weiss, "BlockQuicksort") around the key
+        // of *first, which must be the median of three (medianToFront) so the
+        // first scans below are guarded. Elements >= pivot end up right of the
+        // returned pivot position, elements < pivot left of it.
+        //
+        // The classification loops only add comparison results to buffer
+        // indices; the data never decides a branch. The pivot key is a
+        // reference to *first, which stays put until the final swap.
+        // alreadyPartitioned is set when the prefix/suffix scans met without
+        // finding a misplaced pair, which hints at presorted input.
+        template<typename It, typename Ctx>
+        It blockPartition(It begin, It end, Ctx &c, bool &alreadyPartitioned)
+        {
+            VS_SCOPE(ePARTITION);
+            const typename Ctx::Key &pivot = c.proj(*begin);
+            It first = begin;
+            It last = end;
+
+            // skip the prefix/suffix that is already on the right side
+            while (c.keyLess(c.proj(*++first), pivot))
+                ;
+            if (first - 1 == begin)
+                while (first < last && !c.keyLess(c.proj(*--last), pivot))
+                    ;
+            else
+                while (!c.keyLess(c.proj(*--last), pivot))
+                    ;
+
+            alreadyPartitioned = first >= last;
+            if (first < last)
+            {
+                c.swap(first, last);
+                ++first;
+
+                unsigned char offsetsL[kPartitionBlock];
+                unsigned char offsetsR[kPartitionBlock];
+                It baseL = first;
+                It baseR = last;
+                std::size_t numL = 0, numR = 0, startL = 0, startR = 0;
+
+                while (first < last)
+                {
+                    // refill whichever buffer is empty from the unknown middle
+                    std::size_t unknown = last - first;
+                    std::size_t splitL = numL == 0 ? (numR == 0 ? unknown / 2 : unknown) : 0;
+                    std::size_t splitR = numR == 0 ? (unknown - splitL) : 0;
+                    if (splitL > kPartitionBlock)
+                        splitL = kPartitionBlock;
+                    if (splitR > kPartitionBlock)
+                        splitR = kPartitionBlock;
+
+                    // left block: remember elements that belong on the right
+                    for (std::size_t i = 0; i < splitL; ++i, ++first)
+                    {
+                        offsetsL[numL] = static_cast<unsigned char>(i);
+                        numL += !c.keyLess(c.proj(*first), pivot);
+                    }
+                    // right block: remember elements that belong on the left
+                    for (std::size_t i = 0; i < splitR; )
+                    {
+                        offsetsR[numR] = static_cast<unsigned char>(++i);
+                        numR += c.keyLess(c.proj(*--last), pivot);
+                    }
+
+                    // swap matched pairs in bulk
+                    std::size_t num = numL < numR ? numL : numR;
+                    for (std::size_t i = 0; i < num; ++i)
+                        c.swap(baseL + offsetsL[startL + i], baseR - offsetsR[startR + i]);
+                    numL -= num; numR -= num;
+                    startL += num; startR += num;
+
+                    if (numL == 0)
+                    {
+                        startL = 0;
+                        baseL = first;
+                    }
+                    if (numR == 0)
+                    {
+                        startR = 0;
+                        baseR = last;
+                    }
+                }
+
+                // one side may still hold misplaced elements: move them to the boundary
+                if (numL)
+                {
+                    while (numL--)
+                        c.swap(baseL + offsetsL[startL + numL], --last);
+                    first = last;
+                }
+                if (numR)
+                {
+                    while (numR--)
+                    {
+                        c.swap(baseR - offsetsR[startR + numR], first);
+                        ++first;
+                    }
+                }
+            }
+
+            It pivotPos = first - 1;
+            c.swap(begin, pivotPos);
+            return pivotPos;
+        }
+
+        // Used when the pivot equals the element just before the range (so no
+        // element is smaller): gather every key equal to the pivot on the left.
+        // Returns the first position of the strictly greater part.
+        template<typename It, typename Ctx>
+        It skipEqualKeys(It begin, It end, Ctx &c)
+        {
+            VS_SCOPE(ePARTITION);
+            const typename Ctx::Key &pivot = c.proj(*begin);
+            It first = begin;
+            It last = end;
+
+            while (c.keyLess(pivot, c.proj(*--last)))
+                ;
+            if (last + 1 == end)
+                while (first < last && !c.keyLess(pivot, c.proj(*++first)))
+                    ;
+            else
+                while (!c.keyLess(pivot, c.proj(*++first)))
+                    ;
+
+            while (first < last)
+            {
+                c.swap(first, last);
+                while (c.keyLess(pivot, c.proj(*--last)))
+                    ;
+                while (!c.keyLess(pivot, c.proj(*++first)))
+                    ;
+            }
+            c.swap(begin, last);
+            return last + 1;
+        }
+
+        // leftmost: nothing precedes [first, last) in the array being sorted
+        template<typename It, typename Ctx>
+        void blockQuickSortLoop(It first, It last, Ctx &c, bool leftmost)
+        {
+            while (last - first > kSmallSortThreshold)
+            {
+                medianToFront(first, last, c);
+
+                // *(first - 1) <= every key here; if it equals the pivot, the
+                // whole run of duplicates is already in its final place
+                if (!leftmost && !c.less(first - 1, first))
+                {
+                    first = skipEqualKeys(first, last, c);
+                    continue;
+                }
+
+                bool alreadyPartitioned;
+                It pivotPos = blockPartition(first, last, c, alreadyPartitioned);
+
+                std::ptrdiff_t size = last - first;
+                std::ptrdiff_t leftSize = pivotPos - first;
+                std::ptrdiff_t rightSize = last - (pivotPos + 1);
+                if (leftSize < size / 8 || rightSize < size / 8)
+                {
+                    // unbalanced split: the median-of-three samples sat on a
+                    // pattern (e.g. a sorted run with an unsorted tail), so
+                    // swap a few elements to change the next samples (pdqsort)
+                    if (leftSize > kSmallSortThreshold)
+                    {
+                        c.swap(first, first + leftSize / 4);
+                        c.swap(pivotPos - 1, pivotPos - leftSize / 4);
+                    }
+                    if (rightSize > kSmallSortThreshold)
+                    {
+                        c.swap(pivotPos + 1, pivotPos + 1 + rightSize / 4);
+                        c.swap(last - 1, last - rightSize / 4);
+                    }
+                }
+                else if (alreadyPartitioned && partialInsertionSort(first, pivotPos, c))
+                {
+                    // pdqsort's bailout: a balanced split that moved nothing
+                    // is likely presorted, so both sides may already be done
+                    if (partialInsertionSort(pivotPos + 1, last, c))
+                        return;
+                    first = pivotPos + 1;
+                    leftmost = false;
+                    continue;
+                }
+
+                if (pivotPos - first < last - pivotPos)
+                {
+                    blockQuickSortLoop(first, pivotPos, c, leftmost);
+                    first = pivotPos + 1;
+                    leftmost = false;
+                }
+                else
+                {
+                    blockQuickSortLoop(pivotPos + 1, last, c, false);
+                    last = pivotPos;
+                }
+            }
+            sortSmallRange(first, last, c);
+        }
+
+        //--------------------------------------------------------------------
+        // Adaptive natural-run merge sort (powersort merge policy)
+        //--------------------------------------------------------------------
+
+        // Runs shorter than this are extended with binary insertion sort
+        inline std::size_t minRunLength(std::size_t n)
+        {
+            std::size_t odd = 0;
+            while (n >= 64)
+            {
+                odd |= n & 1;
+                n >>= 1;
+            }
+            return n + odd;
+        }
+
+        // Linear merge steps in a row before switching to galloping
+        const std::size_t kMinGallop = 7;
+
+        // Length of the prefix of [first, last) where pred holds (pred must
+        // be true...true false...false): exponential probe, then binary search
+        template<typename Iter, typename Pred>
+        std::size_t gallopCount(Iter first, Iter last, Pred pred)
+        {
+            std::size_t n = static_cast<std::size_t>(last - first);
+            if (n == 0 || !pred(first[0]))
+                return 0;
+            std::size_t lo = 0, hi = 1;
+            while (hi < n && pred(first[hi]))
+            {
+                lo = hi;
+                hi = hi * 2 + 1;
+            }
+            if (hi > n)
+                hi = n;
+            std::size_t l = lo + 1, r = hi;
+            while (l < r)
+            {
+                std::size_t mid = l + (r - l) / 2;
+                if (pred(first[mid]))
+                    l = mid + 1;
+                else
+                    r = mid;
+            }
+            return l;
+        }
+
+        // Length of the run at first; a strictly descending run is reversed
+        // in place (strict, so equal elements keep their order)
+        template<typename It, typename Ctx>
+        std::size_t countRun(It first, It last, Ctx &c)
+        {
+            It end = first + 1;
+            if (end == last)
+                return 1;
+            if (c.less(end, first))
+            {
+                while (end + 1 != last && c.less(end + 1, end))
+                    ++end;
+                ++end;
+                std::reverse(first, end);
+            }
+            else
+            {
+                while (end + 1 != last && !c.less(end + 1, end))
+                    ++end;
+                ++end;
+            }
+            return static_cast<std::size_t>(end - first);
+        }
+
+        // Stable binary insertion of [sortedEnd, last) into the sorted [first, sortedEnd)
+        template<typename It, typename Ctx>
+        void binaryInsertionSort(It first, It sortedEnd, It last, Ctx &c)
+        {
+            for (It i = sortedEnd; i != last; ++i)
+            {
+                // after every element that is not greater than *i
+                It lo = first, hi = i;
+                while (lo < hi)
+                {
+                    It mid = lo + (hi - lo) / 2;
+                    if (c.less(i, mid))
+                        hi = mid;
+                    else
+                        lo = mid + 1;
+                }
+                std::rotate(lo, i, i + 1);
+            }
+        }
+
+        // Powersort node power of the boundary between run 1 = [s1, s1 + n1)
+        // and run 2 (n2 long) in a range of n elements
+        inline unsigned nodePower(std::size_t s1, std::size_t n1, std::size_t n2, std::size_t n)
+        {
+            unsigned power = 0;
+            std::size_t a = 2 * s1 + n1;
+            std::size_t b = a + n1 + n2;
+            while (true)
+            {
+                ++power;
+                if (a >= n)
+                {
+                    a -= n;
+                    b -= n;
+                }
+                else if (b >= n)
+                    break;
+                a <<= 1;
+                b <<= 1;
+            }
+            return power;
+        }
+
+        template<typename It, typename Ctx>
+        class RunMerger
+        {
+          public:
+            typedef typename std::iterator_traits<It>::value_type Value;
+
+            explicit RunMerger(Ctx &c) : _c(c), _minGallop(kMinGallop), _scratch(mem::eSORT) {}
+
+            // Stable merge of the sorted runs [lo, mid) and [mid, hi)
+            void merge(It lo, It mid, It hi)
+            {
+                // already in order: one comparison (this keeps sorted input O(n))
+                if (!less(*mid, *(mid - 1)))
+                    return;
+                // the head of run 1 and tail of run 2 are already in place
+                const Value &first2 = *mid;
+                lo += gallopCount(lo, mid, [&](const Value &e) { return !less(first2, e); });
+                const Value &last1 = *(mid - 1);
+                hi -= gallopCount(std::reverse_iterator<It>(hi), std::reverse_iterator<It>(mid),
+                                  [&](const Value &e) { return !less(e, last1); });
+                // buffer the shorter side
+                if (mid - lo <= hi - mid)
+                    mergeLo(lo, mid, hi);
+                else
+                    mergeHi(lo, mid, hi);
+            }
+
+          private:
+            bool less(const Value &a, const Value &b)
+            {
+                return _c.keyLess(_c.proj(a), _c.proj(b));
+            }
+
+            // run 1 is buffered; merge front to back
+            void mergeLo(It lo, It mid, It hi)
+            {
+                _buffer.assign(std::make_move_iterator(lo), std::make_move_iterator(mid));
+                _scratch.resize(_buffer.capacity() * sizeof(Value));
+                typename std::vector<Value>::iterator a = _buffer.begin(), aEnd = _buffer.end();
+                It b = mid, dest = lo;
+
+                while (a != aEnd && b != hi)
+                {
+                    std::size_t winsA = 0, winsB = 0;
+                    while (a != aEnd && b != hi && winsA < _minGallop && winsB < _minGallop)
+                    {
+                        // ties take run 1 first: stable
+                        if (less(*b, *a))
+                        {
+                            *dest++ = std::move(*b++);
+                            winsB++;
+                            winsA = 0;
+                        }
+                        else
+                        {
+                            *dest++ = std::move(*a++);
+                            winsA++;
+                            winsB = 0;
+                        }
+                    }
+                    // one side keeps winning: copy whole blocks found by galloping
+                    while (a != aEnd && b != hi)
+                    {
+                        const Value &headB = *b;
+                        std::size_t takeA = gallopCount(a, aEnd, [&](const Value &e) { return !less(headB, e); });
+                        dest = std::move(a, a + takeA, dest);
+                        a += takeA;
+                        if (a == aEnd)
+                            break;
+                        const Value &headA = *a;
+                        std::size_t takeB = gallopCount(b, hi, [&](const Value &e) { return less(e, headA); });
+                        dest = std::move(b, b + takeB, dest);
+                        b += takeB;
+                        if (takeA < kMinGallop && takeB < kMinGallop)
+                        {
+                            _minGallop++;
+                            break;
+                        }
+                        if (_minGallop > 1)
+                            _minGallop--;
+                    }
+                }
+                // what is left of run 2 is already in place
+                std::move(a, aEnd, dest);
+            }
+
+            // run 2 is buffered; merge back to front
+            void mergeHi(It lo, It mid, It hi)
+            {
+                _buffer.assign(std::make_move_iterator(mid), std::make_move_iterator(hi));
+                _scratch.resize(_buffer.capacity() * sizeof(Value));
+                typedef std::reverse_iterator<It> RevIt;
+                typedef std::reverse_iterator<typename std::vector<Value>::iterator> RevBuf;
+                RevIt a(mid), aEnd(lo), dest(hi);
+                RevBuf b(_buffer.end()), bEnd(_buffer.begin());
+
+                while (a != aEnd && b != bEnd)
+                {
+                    std::size_t winsA = 0, winsB = 0;
+                    while (a != aEnd && b != bEnd && winsA < _minGallop && winsB < _minGallop)
+                    {
+                        // from the back, ties take run 2 first: stable
+                        if (less(*b, *a))
+                        {
+                            *dest++ = std::move(*a++);
+                            winsA++;
+                            winsB = 0;
+                        }
+                        else
+                        {
+                            *dest++ = std::move(*b++);
+                            winsB++;
+                            winsA = 0;
+                        }
+                    }
+                    while (a != aEnd && b != bEnd)
+                    {
+                        const Value &tailB = *b;
+                        std::size_t takeA = gallopCount(a, aEnd, [&](const Value &e) { return less(tailB, e); });
+                        dest = std::move(a, a + takeA, dest);
+                        a += takeA;
+                        if (a == aEnd)
+                            break;
+                        const Value &tailA = *a;
+                        std::size_t takeB = gallopCount(b, bEnd, [&](const Value &e) { return !less(e, tailA); });
+                        dest = std::move(b, b + takeB, dest);
+                        b += takeB;
+                        if (takeA < kMinGallop && takeB < kMinGallop)
+                        {
+                            _minGallop++;
+                            break;
+                        }
+                        if (_minGallop > 1)
+                            _minGallop--;
+                    }
+                }
+                // what is left of run 1 is already in place
+                std::move(b, bEnd, dest);
+            }
+
+            Ctx &_c;
+            std::size_t _minGallop;
+            std::vector<Value> _buffer;
+            mem::Reservation _scratch; // _buffer's capacity, charged to mem::eSORT
+        };
+
+        template<typename It, typename Ctx>
+        void powerSortLoop(It first, It last, Ctx &c)
+        {
+            const std::size_t n = static_cast<std::size_t>(last - first);
+            if (n < 2)
+                return;
+            const std::size_t minRun = minRunLength(n);
+
+            struct Run
+            {
+                std::size_t start;
+                std::size_t length;
+                unsigned power; // of the boundary after this run
+            };
+            std::vector<Run> stack;
+            RunMerger<It, Ctx> merger(c);
+            std::uint64_t runs = 0;
+
+            for (std::size_t start = 0; start < n;)
+            {
+                std::size_t length = countRun(first + start, last, c);
+                runs++;
+                if (length < minRun)
+                {
+                    std::size_t forced = std::min(minRun, n - start);
+                    binaryInsertionSort(first + start, first + start + length, first + start + forced, c);
+                    length = forced;
+                }
+                if (!stack.empty())
+                {
+                    unsigned power = nodePower(stack.back().start, stack.back().length, length, n);
+                    // merge while the boundary below is deeper in the powersort tree
+                    while (stack.size() > 1 && stack[stack.size() - 2].power > power)
+                    {
+                        Run top = stack.back();
+                        stack.pop_back();
+                        Run &below = stack.back();
+                        merger.merge(first + below.start, first + top.start, first + top.start + top.length);
+                        below.length += top.length;
+                    }
+                    stack.back().power = power;
+                }
+                Run run = { start, length, 0 };
+                stack.push_back(run);
+                start += length;
+            }
+            while (stack.size() > 1)
+            {
+                Run top = stack.back();
+                stack.pop_back();
+                Run &below = stack.back();
+                merger.merge(first + below.start, first + top.start, first + top.start + top.length);
+                below.length += top.length;
+            }
+            VS_COUNT(eRUNS, runs);
+        }
+    }
+
+    /**
+     * Quick sort [first, last) by proj(element) using comp
+     * Average performance: O(n log(n)), not stable
+     *
+     * @param strategy eHOARE (classic loop) or eBLOCK (branch-free block partition)
+     */
+    template<typename It, typename Proj = Identity, typename Comp = Less>
+    void quickSort(It first, It last, Proj proj = Proj(), Comp comp = Comp(),
+                   PartitionStrategy strategy = eHOARE)
+    {
+        VS_SCOPE(eSORT);
+        detail::Context<It, Proj, Comp> c(proj, comp);
+        if (strategy == eBLOCK)
+            detail::blockQuickSortLoop(first, last, c, true);
+        else
+            detail::quickSortLoop(first, last, c);
+    }
+
+    // Menu/CLI names for the strategies
+    inline const char *partitionName(PartitionStrategy strategy)
+    {
+        return strategy == eBLOCK ? "block" : "hoare";
+    }
+
+    /**
+     * Selection sort [first, last) by proj(element) using comp
+     * Performance: O(n^2) comparisons, at most n - 1 swaps
+     */
+    template<typename It, typename Proj = Identity, typename Comp = Less>
+    void selectionSort(It first, It last, Proj proj = Proj(), Comp comp = Comp())
+    {
+        VS_SCOPE(eSORT);
+        detail::Context<It, Proj, Comp> c(proj, comp);
+
+        for (It pos = first; pos != last; ++pos)
+        {
+            It minIt = pos;
+            for (It j = pos + 1; j < last; ++j)
+            {
+                // select without branching on the outcome
+                bool smaller = c.less(j, minIt);
+                minIt = smaller ? j : minIt;
+            }
+            if (minIt != pos)
+                c.swap(pos, minIt);
+        }
+    }
+
+    // Most merge buffer adaptiveSort can need for n elements (the shorter run)
+    template<typename Value>
+    std::size_t adaptiveScratchBytes(std::size_t n)
+    {
+        return n / 2 * sizeof(Value);
+    }
+
+    /**
+     * Adaptive natural-run merge sort [first, last) by proj(element) using comp
+     * Finds ascending (and strictly descending, reversed) runs and merges
+     * them in powersort order with galloping merges. Stable.
+     * Performance: O(n) on sorted or reverse-sorted input, O(n log(n)) worst
+     */
+    template<typename It, typename Proj = Identity, typename Comp = Less>
+    void adaptiveSort(It first, It last, Proj proj = Proj(), Comp comp = Comp())
+    {
+        VS_SCOPE(eSORT);
+        detail::Context<It, Proj, Comp> c(proj, comp);
+        detail::powerSortLoop(first, last, c);
+    }
+
+    // Adjacent pairs sampled by sampleOrder, and how they compared
+    struct OrderSample
+    {
+        std::size_t pairs;
+        std::size_t ascending;  // a[i] <= a[i + 1]
+        std::size_t descending; // a[i] > a[i + 1]
+
+        OrderSample(void) : pairs(0), ascending(0), descending(0) {}
+
+        // Mostly one direction: natural runs will be long
+        bool presorted(void) const
+        {
+            return pairs > 0 && (ascending * 8 >= pairs * 7 || descending * 8 >= pairs * 7);
+        }
+    };
+
+    /**
+     * Estimate how presorted [first, last) is from up to maxPairs evenly
+     * spaced adjacent pairs (cost independent of n)
+     */
+    template<typename It, typename Proj = Identity, typename Comp = Less>
+    OrderSample sampleOrder(It first, It last, Proj proj = Proj(), Comp comp = Comp(),
+                            std::size_t maxPairs = 256)
+    {
+        OrderSample sample;
+        std::size_t n = static_cast<std::size_t>(last - first);
+        if (n < 2 || maxPairs == 0)
+            return sample;
+        std::size_t step = (n - 1) / maxPairs;
+        if (step == 0)
+            step = 1;
+        for (std::size_t i = 0; i + 1 < n && sample.pairs < maxPairs; i += step)
+        {
+            sample.pairs++;
+            if (comp(proj(*(first + i + 1)), proj(*(first + i))))
+                sample.descending++;
+            else
+                sample.ascending++;
+        }
+        return sample;
+    }
+
+    /**
+     * Insertion sort [first, last); small ranges use a sorting network.
+     * (not stable either way)
+     */
+    template<typename It, typename Proj = Identity, typename Comp = Less>
+    void smallSort(It first, It last, Proj proj = Proj(), Comp comp = Comp())
+    {
+        detail::Context<It, Proj, Comp> c(proj, comp);
+        detail::sortSmallRange(first, last, c);
+    }
+}
+
+#endif /*!_SORTKERNELS_HPP_*/
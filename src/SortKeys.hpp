@@ -0,0 +1,242 @@
+#ifndef     _SORTKEYS_HPP_
+# define    _SORTKEYS_HPP_
+
+# include <cstdint>
+# include <cstring>
+# include <string>
+# include <utility>
+# include <vector>
+# include "SortKernels.hpp"
+
+//============================================================================
+// Normalized sort keys.
+//
+// Each record's key is encoded once into a 16-byte, order-preserving binary
+// prefix held as two integers. Sorting then moves small (key, index) pairs
+// and compares two words per step; the full key is only consulted when two
+// prefixes tie. Finally the records are permuted into place in one pass.
+//
+// Encoders assume keys contain no NUL bytes (true for CSV text): shorter
+// strings pad with zeros, so "ab" < "abc" holds on the prefix as well.
+//============================================================================
+
+namespace vsort
+{
+    // 16-byte order-preserving key; compares like the big-endian bytes it holds
+    struct NormalizedKey
+    {
+        std::uint64_t hi;
+        std::uint64_t lo;
+
+        bool operator<(const NormalizedKey &other) const
+        {
+            // no short-circuit: both words are compared every time
+            return (hi < other.hi) | ((hi == other.hi) & (lo < other.lo));
+        }
+        bool operator==(const NormalizedKey &other) const
+        {
+            return (hi == other.hi) & (lo == other.lo);
+        }
+    };
+
+    namespace detail
+    {
+        // Big-endian load of up to 8 bytes, zero padded on the right
+        inline std::uint64_t loadPrefix(const char *data, std::size_t size)
+        {
+            unsigned char buf[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+            std::memcpy(buf, data, size < 8 ? size : 8);
+            std::uint64_t word = 0;
+            for (int i = 0; i < 8; i++)
+                word = (word << 8) | buf[i];
+            return word;
+        }
+
+        inline char foldAscii(char ch)
+        {
+            return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+        }
+    }
+
+    /**
+     * First 16 bytes of a string, byte order (same order as std::string::operator<)
+     */
+    inline NormalizedKey encodeString(const std::string &s)
+    {
+        NormalizedKey key;
+        key.hi = detail::loadPrefix(s.data(), s.size());
+        key.lo = s.size() > 8 ? detail::loadPrefix(s.data() + 8, s.size() - 8) : 0;
+        return key;
+    }
+
+    /**
+     * First 16 bytes of a string with ASCII letters folded to lower case
+     */
+    inline NormalizedKey encodeFolded(const std::string &s)
+    {
+        char buf[16];
+        std::size_t n = s.size() < 16 ? s.size() : 16;
+        for (std::size_t i = 0; i < n; i++)
+            buf[i] = detail::foldAscii(s[i]);
+        NormalizedKey key;
+        key.hi = detail::loadPrefix(buf, n);
+        key.lo = n > 8 ? detail::loadPrefix(buf + 8, n - 8) : 0;
+        return key;
+    }
+
+    /**
+     * Doubles as unsigned integers with the same order: flip every bit of
+     * negatives, only the sign bit of positives. The key is exact (no ties
+     * except equal values).
+     */
+    inline NormalizedKey encodeDouble(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const std::uint64_t sign = static_cast<std::uint64_t>(1) << 63;
+        NormalizedKey key;
+        key.hi = (bits & sign) ? ~bits : (bits | sign);
+        key.lo = 0;
+        return key;
+    }
+
+    /**
+     * Compound (major, minor) string key: 8 bytes of each. The minor part is
+     * only meaningful when the major string fit entirely; a longer major
+     * string gets an all-ones minor word so it still sorts after any string
+     * it extends, and equal long majors tie and fall back to the full key.
+     */
+    inline NormalizedKey encodeCompound(const std::string &major, const std::string &minor)
+    {
+        NormalizedKey key;
+        key.hi = detail::loadPrefix(major.data(), major.size());
+        key.lo = major.size() <= 8 ? detail::loadPrefix(minor.data(), minor.size())
+                                   : ~static_cast<std::uint64_t>(0);
+        return key;
+    }
+
+    // A record's encoded key plus its position in the input
+    struct KeyedIndex
+    {
+        NormalizedKey key;
+        std::uint32_t index;
+    };
+
+    namespace detail
+    {
+        // Prefix compare first, full comparison only when the prefixes tie
+        template<typename It, typename Proj, typename Comp>
+        class TieBreakLess
+        {
+          public:
+            // ties: caller-owned tally (the engines copy the comparator)
+            TieBreakLess(It base, Proj proj, Comp comp, std::uint64_t *ties)
+              : _base(base), _proj(proj), _comp(comp), _ties(ties) {}
+
+            bool operator()(const KeyedIndex &a, const KeyedIndex &b)
+            {
+                if (a.key < b.key)
+                    return true;
+                if (b.key < a.key)
+                    return false;
+                VS_TALLY(*_ties);
+                return _comp(_proj(*(_base + a.index)), _proj(*(_base + b.index)));
+            }
+
+          private:
+            It _base;
+            Proj _proj;
+            Comp _comp;
+            std::uint64_t *_ties;
+        };
+    }
+
+    // Sorter adaptors so sortNormalized can drive any comparison engine
+    struct QuickSorter
+    {
+        PartitionStrategy strategy;
+
+        explicit QuickSorter(PartitionStrategy s = eBLOCK) : strategy(s) {}
+
+        template<typename It, typename Comp>
+        void operator()(It first, It last, Comp comp) const
+        {
+            quickSort(first, last, Identity(), comp, strategy);
+        }
+    };
+
+    struct SelectionSorter
+    {
+        template<typename It, typename Comp>
+        void operator()(It first, It last, Comp comp) const
+        {
+            selectionSort(first, last, Identity(), comp);
+        }
+    };
+
+    struct AdaptiveSorter
+    {
+        template<typename It, typename Comp>
+        void operator()(It first, It last, Comp comp) const
+        {
+            adaptiveSort(first, last, Identity(), comp);
+        }
+    };
+
+    /**
+     * Scratch space sortNormalized allocates for n records: the (key, index)
+     * pairs and the buffer the records are permuted through
+     */
+    template<typename Value>
+    std::size_t normalizedScratchBytes(std::size_t n)
+    {
+        return n * (sizeof(KeyedIndex) + sizeof(Value));
+    }
+
+    /**
+     * Sort [first, last) through normalized keys
+     *
+     * @param encode  element -> NormalizedKey, must agree with proj/comp order
+     * @param proj    full key for tie breaks (e.g. the whole title)
+     * @param comp    full key comparator
+     * @param sorter  engine run on the (key, index) pairs, e.g. QuickSorter
+     */
+    template<typename It, typename Encode, typename Proj, typename Comp, typename Sorter>
+    void sortNormalized(It first, It last, Encode encode, Proj proj, Comp comp, Sorter sorter)
+    {
+        typedef typename std::iterator_traits<It>::value_type Value;
+        const std::size_t n = static_cast<std::size_t>(last - first);
+        if (n < 2)
+            return;
+
+        mem::Reservation scratch(mem::eSORT, normalizedScratchBytes<Value>(n));
+        std::vector<KeyedIndex> keys(n);
+        {
+            VS_SCOPE(eENCODE);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                keys[i].key = encode(*(first + i));
+                keys[i].index = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        std::uint64_t ties = 0;
+        sorter(keys.begin(), keys.end(), detail::TieBreakLess<It, Proj, Comp>(first, proj, comp, &ties));
+        VS_COUNT(eKEY_TIES, ties);
+
+        // apply the permutation: move every record once into scratch, then back
+        std::vector<Value> sorted;
+        sorted.reserve(n);
+        for (std::size_t i = 0; i < n; i++)
+            sorted.push_back(std::move(*(first + keys[i].index)));
+        std::move(sorted.begin(), sorted.end(), first);
+    }
+
+    template<typename It, typename Encode, typename Proj, typename Sorter>
+    void sortNormalized(It first, It last, Encode encode, Proj proj, Sorter sorter)
+    {
+        sortNormalized(first, last, encode, proj, Less(), sorter);
+    }
+}
+
+#endif /*!_SORTKEYS_HPP_*/
@@ -0,0 +1,92 @@
+#ifndef     _THREADPOOL_HPP_
+# define    _THREADPOOL_HPP_
+
+# include <condition_variable>
+# include <deque>
+# include <functional>
+# include <future>
+# include <memory>
+# include <mutex>
+# include <thread>
+# include <type_traits>
+# include <vector>
+
+/**
+ * Fixed-size pool of worker threads fed from one FIFO queue.
+ * submit() returns a future for the task's result (exceptions included).
+ * The destructor finishes every queued task, then joins the workers.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threads) : _stop(false) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (unsigned int i = 0; i < threads; i++) {
+            _workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stop = true;
+        }
+        _cond.notify_all();
+        for (auto &worker: _workers) {
+            worker.join();
+        }
+    }
+
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F task) {
+        typedef typename std::result_of<F()>::type Result;
+        // packaged_task is move-only; share it so std::function can copy the wrapper
+        auto packaged = std::make_shared<std::packaged_task<Result()> >(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _queue.push_back([packaged] { (*packaged)(); });
+        }
+        _cond.notify_one();
+        return result;
+    }
+
+    unsigned int size() const {
+        return static_cast<unsigned int>(_workers.size());
+    }
+
+    // Worker count for "use every core" (at least 1)
+    static unsigned int defaultThreads() {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> guard(_lock);
+                _cond.wait(guard, [this] { return _stop || !_queue.empty(); });
+                if (_queue.empty()) {
+                    return; // stopping and drained
+                }
+                task = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()> > _queue;
+    std::mutex _lock;
+    std::condition_variable _cond;
+    bool _stop;
+};
+
+#endif /*!_THREADPOOL_HPP_*/
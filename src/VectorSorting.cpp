@@ -10,12 +10,26 @@
 // Record start/end times using steady_clock to get accurate elapsed duration
 // Accounts for OS scheduling, multithreading, and background process interference
 #include <chrono> 
+#include "Bid.hpp"
+#include "BidLoader.hpp"        // single and concurrent multi-file bid loading
+#include "BidRenderer.hpp"      // batched bid output and the pager behind menu 2
+#include "BidServer.hpp"        // resident server over a Unix socket (--serve / --connect)
+#include "BidStore.hpp"         // immutable bid versions swapped in by a background writer
+#include "Columnar.hpp"           // mmap-able columnar export/import (menu 13)
 #include "CSVparser.hpp"
+#include "FileWatch.hpp"          // inotify wake-ups for live tail (menu 12)
+#include "Instrumentation.hpp" // VS_SCOPE / VS_COUNT probes for the phase breakdown (menu 8)
+#include "MemoryBudget.hpp"    // per-subsystem memory accounting and --memory-budget
+#include "SortKernels.hpp"     // header-only quick/selection sort kernels
+#include "SortKeys.hpp"        // 16-byte normalized sort keys
 #include <iomanip> // for std::fixed and std::setprecision (needed for added box prints)
 #include <limits>  // for std::numeric_limits used in input pause
 #include <cctype>  // for std::isspace used in string cleanup
 #include <fstream>  // for std::ofstream used to append to CSV
 #include <sstream>  // for std::ostringstream used to format amount
+#include <memory>   // for std::make_shared used to hand tailed batches to the writer
+#include <sys/stat.h> // for stat() used to track the tail offset across our own appends
+#include <unistd.h> // for STDIN_FILENO watched alongside the CSV in live tail mode
 
 
 using namespace std;
@@ -31,9 +45,6 @@ const char *YL = "\x1b[33m"; //yellow
 // Global definitions visible to all methods and classes
 //============================================================================
 
-// forward declarations
-double strToDouble(string str, char ch);
-
 // Small helper so I don't copy/paste the same pause code everywhere.
 // Shows a prompt and waits so the user actually has time to read messages to console
 void pauseForUser() {
@@ -46,18 +57,6 @@ void pauseForUser() {
     std::getline(cin, _pauseLine);
 }
 
-// define a structure to hold bid information
-struct Bid {
-    string bidId; // unique identifiers
-    string title;
-    string fund;
-    double amount;
-
-    Bid() {
-        amount = 0.0; //initialize amount to 0.0
-    }
-};
-
 //-----------------------------------------------------------------------------
 // Simple CSV helpers
 //-----------------------------------------------------------------------------
@@ -85,11 +84,24 @@ static string csvEscape(const string &field) {
 // Append a bid to the given CSV file using the same column ordering used by loadBids
 // Columns (21 total):
 static bool appendBidToCsv(const Bid &bid, const string &csvPath) {
+    // A last line without its newline would swallow the new row
+    bool needsNewline = false;
+    {
+        std::ifstream in(csvPath, std::ios::binary | std::ios::ate);
+        if (in && in.tellg() > 0) {
+            in.seekg(-1, std::ios::end);
+            needsNewline = in.get() != '\n';
+        }
+    }
+
     // Open in append mode; don't truncate existing data
     std::ofstream out(csvPath, std::ios::app);
     if (!out.is_open()) {
         return false; // couldn't open file
     }
+    if (needsNewline) {
+        out << '\n';
+    }
 
     // Minimal row: fill known columns; leave others empty
     // Note: loadBids reads Title [0], Auction ID [1], Fund [8], Winning Bid [4]
@@ -125,24 +137,34 @@ static bool appendBidToCsv(const Bid &bid, const string &csvPath) {
     return true;
 }
 
+// Split "LO..HI" into its two (possibly empty) bounds
+static bool splitRange(const string &range, string &lo, string &hi) {
+    size_t dots = range.find("..");
+    if (dots == string::npos) {
+        return false;
+    }
+    lo = range.substr(0, dots);
+    hi = range.substr(dots + 2);
+    return true;
+}
+
+// Default export path: the CSV path with its extension swapped for .vsc
+static string columnarPathFor(const string &csvPath) {
+    size_t slash = csvPath.find_last_of('/');
+    size_t dot = csvPath.find('.', slash == string::npos ? 0 : slash + 1);
+    return (dot == string::npos ? csvPath : csvPath.substr(0, dot)) + ".vsc";
+}
+
+// Current size of a file in bytes (-1 if it can't be stat'ed)
+static long long fileSize(const string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+}
+
 //============================================================================
 // Static methods used for testing
 //============================================================================
 
-/**
- * Display the bid information to the console (std::out)
- *
- * @param bid struct containing the bid info
- */
-void displayBid(Bid bid) {
-    // Print with labels similar to CSV, TODO: double check columns
-    cout << "Auction ID: " << bid.bidId
-            << " | Title: " << bid.title
-            << " | Winning Bid: $" << fixed << setprecision(2) << bid.amount
-            << " | Fund: " << bid.fund << endl;
-    return;
-}
-
 /**
  * Prompt user for bid information using console (std::in)
  *
@@ -174,93 +196,32 @@ Bid getBid() {
 }
 
 /**
- * Load a CSV file containing bids into a container
- *
- * @param csvPath the path to the CSV file to load
- * @return a container holding all the bids read
+ * Sort key projection handed to the vsort kernels: compare bids by title.
+ * Returns a reference so no string is copied per comparison.
  */
-vector<Bid> loadBids(string csvPath) {
-    cout << "Loading CSV file " << csvPath << endl;
-
-    // Define a vector data structure to hold a collection of bids.
-    vector<Bid> bids;
-
-    // initialize the CSV Parser using the given path
-    csv::Parser file = csv::Parser(csvPath);
-
-    try {
-        //loop to read rows of a CSV file
-        //unsigned int to match csv::Parser rowCount() method
-        for (unsigned int i = 0; i < file.rowCount(); i++) {
-            // Data structure and add to the collection of bids, **hardcoded for now**
-            Bid bid;
-            bid.title = file[i][0];
-            bid.bidId = file[i][1];
-            bid.fund = file[i][8];
-            bid.amount = strToDouble(file[i][4], '$');
-            //***TODO: This is hardcoded!***
-
-            //cout << "Item: " << bid.title << ", Fund: " << bid.fund << ", Amount: " << bid.amount << endl;
-
-            // push this bid to the end
-            bids.push_back(bid);
-        }
-    } catch (csv::Error &e) {
-        // catch any errors, print error message to console
-        std::cerr << e.what() << std::endl;
+struct BidTitle {
+    const string &operator()(const Bid &bid) const {
+        return bid.title;
     }
-    return bids;
-}
-
+};
 
 /**
- * Partition the vector of bids into two parts, low and high
- *
- * @param bids Address of the vector<Bid> instance to be partitioned
- * @param begin Beginning index to partition
- * @param end Ending index to partition
+ * Normalized-key encoder for the same order: first 16 bytes of the title.
+ * Sorts compare these integers and only fall back to BidTitle on ties.
  */
-int partition(vector<Bid> &bids, int begin, int end) {
-    //set low and high equal to begin and end
-    int low = begin;
-    int high = end;
-
-    // Calculate the middle element as middlePoint (int)
-    //Pivot point in the middle of the vector
-    int middlePoint = begin + (end - begin) / 2;
-
-    // Set Pivot as middlePoint element title to compare (string)
-    string pivot = bids[middlePoint].title;
-
-
-    //bool because done is either true or false
-    bool done = false;
-    while (!done) {
-        // keep incrementing low index while bids[low].title < Pivot
-        while (bids[low].title < pivot) {
-            low += 1;
-        }
-        // keep decrementing high index while Pivot < bids[high].title
-        while (pivot < bids[high].title) {
-            high -= 1;
-        }
-
-        /* If there are zero or one elements remaining,
-            all bids are partitioned. Return high */
-        if (low >= high) {
-            done = true;
-        } else {
-            // else swap the low and high bids (built in vector method)
-            swap(bids[low], bids[high]);
-
-            // low needs to go towards high that is -->, then increment ++
-            low += 1;
-            //high needs to go towards low that is  <--, then decrement --
-            high -= 1;
-        }
+struct EncodeBidTitle {
+    vsort::NormalizedKey operator()(const Bid &bid) const {
+        return vsort::encodeString(bid.title);
     }
-    //return high because it is the last element in low partition
-    return high;
+};
+
+/**
+ * Whether a sort of n bids can compare normalized keys. The keys need
+ * scratch space beside the bids; under a memory budget (--memory-budget=)
+ * that has to fit, otherwise the titles are compared in place.
+ */
+bool keysFit(bool normalizedKeys, size_t n) {
+    return normalizedKeys && mem::fits(vsort::normalizedScratchBytes<Bid>(n));
 }
 
 /**
@@ -268,28 +229,28 @@ int partition(vector<Bid> &bids, int begin, int end) {
  * Average performance: O(n log(n))
  * Worst case performance O(n^2))
  *
+ * Partition and recursion live in the header-only kernels
+ * (SortKernels.hpp), shared with csv::Parser::sortBy.
+ *
  * @param bids address of the vector<Bid> instance to be sorted
  * @param begin the beginning index to sort on
  * @param end the ending index to sort on
+ * @param strategy Hoare loop or branch-free block partition (menu 10 / --partition=)
+ * @param normalizedKeys compare 16-byte title prefixes instead of strings (menu 11 / --keys=)
  */
-void quickSort(vector<Bid> &bids, int begin, int end) {
-    /* Base case: If there are 1 or zero bids to sort,
-     partition is already sorted otherwise if begin is greater
-     than or equal to end then return*/
-
+void quickSort(vector<Bid> &bids, int begin, int end, vsort::PartitionStrategy strategy = vsort::eBLOCK,
+               bool normalizedKeys = true) {
+    // Base case: 1 or zero bids are already sorted
     if (begin >= end) {
-        //bids are already sorted, return.
         return;
     }
-
-    /* Partition bids into low and high such that
-     midpoint is location of last element in low */
-    int partitionIndex = partition(bids, begin, end);
-
-    // recursively sort left partition
-    quickSort(bids, begin, partitionIndex);
-    // recursively sort the right partition
-    quickSort(bids, partitionIndex + 1, end);
+    // kernels work on the half-open range [first, last)
+    if (keysFit(normalizedKeys, end - begin + 1)) {
+        vsort::sortNormalized(bids.begin() + begin, bids.begin() + end + 1, EncodeBidTitle(), BidTitle(),
+                              vsort::QuickSorter(strategy));
+    } else {
+        vsort::quickSort(bids.begin() + begin, bids.begin() + end + 1, BidTitle(), vsort::Less(), strategy);
+    }
 }
 
 
@@ -300,47 +261,57 @@ void quickSort(vector<Bid> &bids, int begin, int end) {
  *
  * @param bid address of the vector<Bid>
  *            instance to be sorted
+ * @param normalizedKeys compare 16-byte title prefixes instead of strings
  */
-void selectionSort(vector<Bid> &bids) {
-    //define minindex of the current minimum bid)
-    int minIndex;
-    //get size of the bids vector, hold in size_t variable
-    size_t size = bids.size();
-
-    
-    for (size_t pos = 0; pos < size - 1; ++pos) {
-        minIndex = pos;
-
-        //loop over the remaining elements to the right of position; declare as j to avoid confuction with size_t pos
-        for (size_t j = pos + 1; j < size; ++j) {
-            if (bids[j].title < bids[minIndex].title) {
-                minIndex = j;
-            }
-        }
-        // if the minIndex is not the pos swap
-        if (minIndex != pos) {
-            swap(bids[pos], bids[minIndex]);
-        }
+void selectionSort(vector<Bid> &bids, bool normalizedKeys = true) {
+    if (keysFit(normalizedKeys, bids.size())) {
+        vsort::sortNormalized(bids.begin(), bids.end(), EncodeBidTitle(), BidTitle(), vsort::SelectionSorter());
+    } else {
+        vsort::selectionSort(bids.begin(), bids.end(), BidTitle());
     }
 }
 
 /**
- * Simple C function to convert a string to a double
- * after stripping out unwanted char
+ * Sort bids by title with the engine that suits their current order.
+ * A few hundred adjacent pairs are sampled: mostly ascending or mostly
+ * descending input goes to the adaptive run-merging sort (O(n) when
+ * already sorted), anything else to quick sort. The adaptive path always
+ * compares plain titles: with long runs it needs about n comparisons,
+ * fewer than it would take to encode normalized keys. Its merge buffer
+ * must fit the memory budget, else quick sort (in place) runs instead.
  *
- * credit: http://stackoverflow.com/a/24875936
+ * @param sample receives what the sampling saw
+ * @return the engine used ("adaptive" or "quick")
+ */
+const char *autoSort(vector<Bid> &bids, vsort::PartitionStrategy strategy, bool normalizedKeys,
+                     vsort::OrderSample &sample) {
+    sample = vsort::sampleOrder(bids.begin(), bids.end(), BidTitle());
+    if (!sample.presorted() || !mem::fits(vsort::adaptiveScratchBytes<Bid>(bids.size()))) {
+        quickSort(bids, 0, bids.size() - 1, strategy, normalizedKeys);
+        return "quick";
+    }
+    vsort::adaptiveSort(bids.begin(), bids.end(), BidTitle());
+    return "adaptive";
+}
+
+/**
+ * Add newly tailed bids to the in-memory list. When the list is sorted by
+ * title, the batch is sorted on its own and merged in; only the slices it
+ * lands in are rewritten, the rest stay shared with the previous version
+ * (cost follows the new data).
  *
- * @param ch The character to strip out
+ * @param bids the loaded bids
+ * @param batch the new bids (moved from)
+ * @param sorted whether bids is currently in title order
  */
-double strToDouble(string str, char ch) {
-    // Removes the specified character (ex '$')
-    str.erase(remove(str.begin(), str.end(), ch), str.end());
-    // Removes common numeric formatting characters like commas
-    str.erase(remove(str.begin(), str.end(), ','), str.end());
-    // Trim spaces just in case (extra whitespace)
-    str.erase(remove_if(str.begin(), str.end(), [](unsigned char c) { return std::isspace(c); }), str.end());
-    // Convert cleaned string to double
-    return atof(str.c_str());
+void mergeBids(BidList &bids, vector<Bid> &batch, bool sorted, vsort::PartitionStrategy strategy,
+               bool normalizedKeys) {
+    if (!sorted) {
+        bids.append(std::move(batch));
+        return;
+    }
+    quickSort(batch, 0, batch.size() - 1, strategy, normalizedKeys);
+    bids.mergeSorted(std::move(batch), [](const Bid &a, const Bid &b) { return a.title < b.title; });
 }
 
 /**
@@ -348,24 +319,158 @@ double strToDouble(string str, char ch) {
  */
 int main(int argc, char *argv[]) {
     // process the command line arguments
-    string csvPath;
-    switch (argc) {
-        case 2:
-            csvPath = argv[1]; //argv[1] first argument after executable
-            break;
-        default:
-            csvPath = "data/eBid_Monthly_Sales.csv"; //path to default CSV file. TODO: Allow user to import their own CSV
+    // Options start with "--"; anything else is a CSV path or glob (several may be given)
+    string csvPath = "data/eBid_Monthly_Sales.csv"; //path to default CSV file (also where added bids go)
+    vector<string> inputs;
+    string profileJsonPath; // --profile-json=FILE : dump instrumentation counters as JSON on exit
+    string tracePath;       // --trace=FILE : write Chrome trace events on exit
+    // --partition=hoare|block : how quick sort splits ranges (block is branch-free and
+    // bails out on presorted ranges; hoare swaps less on sorted data with an unsorted tail)
+    vsort::PartitionStrategy partitionStrategy = vsort::eBLOCK;
+    // --keys=plain|normalized : compare title strings or encoded 16-byte prefixes
+    bool normalizedKeys = true;
+    // --direct-io : bypass the page cache when loading; --read-buffer-kb=N : size of each read buffer
+    csv::ReadOptions readOptions;
+    // --dedupe=first|last : which copy of a repeated Auction ID survives a multi-file load
+    DuplicatePolicy duplicatePolicy = eKEEP_FIRST;
+    bool dedupeRequested = false;
+    // --threads=N : loader threads for multi-file loads (0 = one per core)
+    unsigned int loadThreads = 0;
+    // --title=LO..HI / --amount=LO..HI : rows wanted from a columnar (.vsc) input;
+    // row groups whose min/max statistics miss the range are never decoded
+    ColumnarFilter columnarFilter;
+    // --serve=SOCKET : load once and answer requests on a Unix socket (no menu)
+    // --connect=SOCKET : send the remaining arguments (or stdin lines) to that server
+    // --workers=N : connections the server handles at once
+    string servePath, connectPath;
+    unsigned int serverWorkers = 0;
+    // --memory-budget=SIZE (512M, 2G, ...) : cap on accounted memory; loads
+    // stream rows or stop with an estimate, sorts skip scratch, to stay under it
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 15, "--profile-json=") == 0) {
+            profileJsonPath = arg.substr(15);
+        } else if (arg.compare(0, 8, "--trace=") == 0) {
+            tracePath = arg.substr(8);
+            instr::enableTrace(true);
+        } else if (arg == "--partition=hoare") {
+            partitionStrategy = vsort::eHOARE;
+        } else if (arg == "--partition=block") {
+            partitionStrategy = vsort::eBLOCK;
+        } else if (arg == "--keys=plain") {
+            normalizedKeys = false;
+        } else if (arg == "--keys=normalized") {
+            normalizedKeys = true;
+        } else if (arg == "--direct-io") {
+            readOptions.directIO = true;
+        } else if (arg.compare(0, 17, "--read-buffer-kb=") == 0) {
+            readOptions.bufferSize = static_cast<size_t>(atol(arg.substr(17).c_str())) * 1024;
+        } else if (arg == "--dedupe=first") {
+            duplicatePolicy = eKEEP_FIRST;
+            dedupeRequested = true;
+        } else if (arg == "--dedupe=last") {
+            duplicatePolicy = eKEEP_LAST;
+            dedupeRequested = true;
+        } else if (arg.compare(0, 8, "--title=") == 0) {
+            columnarFilter.byTitle = splitRange(arg.substr(8), columnarFilter.titleMin, columnarFilter.titleMax);
+        } else if (arg.compare(0, 9, "--amount=") == 0) {
+            string lo, hi;
+            if (splitRange(arg.substr(9), lo, hi)) {
+                columnarFilter.byAmount = true;
+                columnarFilter.amountMin = lo.empty() ? -numeric_limits<double>::infinity() : atof(lo.c_str());
+                columnarFilter.amountMax = hi.empty() ? numeric_limits<double>::infinity() : atof(hi.c_str());
+            }
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            loadThreads = static_cast<unsigned int>(atoi(arg.substr(10).c_str()));
+        } else if (arg.compare(0, 8, "--serve=") == 0) {
+            servePath = arg.substr(8);
+        } else if (arg.compare(0, 10, "--connect=") == 0) {
+            connectPath = arg.substr(10);
+        } else if (arg.compare(0, 10, "--workers=") == 0) {
+            serverWorkers = static_cast<unsigned int>(atoi(arg.substr(10).c_str()));
+        } else if (arg.compare(0, 16, "--memory-budget=") == 0) {
+            size_t budget = mem::parseBytes(arg.substr(16));
+            if (budget == 0) {
+                std::cerr << "Ignoring " << arg << " (expected a size such as 512M or 2G)" << std::endl;
+            }
+            mem::setBudget(budget);
+        } else {
+            inputs.push_back(arg); //non-option arguments after executable
+        }
+    }
+    if (!connectPath.empty()) {
+        // client mode: the non-option arguments are requests, not CSV files
+        return askServer(connectPath, inputs);
+    }
+    if (!servePath.empty()) {
+        ServerOptions serverOptions;
+        serverOptions.socketPath = servePath;
+        serverOptions.inputs = inputs.empty() ? vector<string>(1, csvPath) : inputs;
+        serverOptions.policy = duplicatePolicy;
+        serverOptions.loadThreads = loadThreads;
+        serverOptions.workers = serverWorkers;
+        serverOptions.readOptions = readOptions;
+        return serveBids(serverOptions);
     }
 
-    // Define a vector to hold all the bids
-    vector<Bid> bids;
+    // Expand globs once; a single plain CSV is also the one "Add a Bid" appends to
+    vector<string> inputPaths = expandInputs(inputs.empty() ? vector<string>(1, csvPath) : inputs);
+    csvPath = inputPaths.front();
+    // several files (or an explicit --dedupe) go through the concurrent, de-duplicating loader
+    bool multiFile = inputPaths.size() > 1 || dedupeRequested;
+    // stdin, FIFOs and <(...) among the inputs are drained by the first load
+    bool streamedInput = any_of(inputPaths.begin(), inputPaths.end(), isStreamedInput);
+    bool inputDrained = false;
+    LoadStats loadStats;
+    // estimate and path of the last single-file load under a memory budget
+    LoadPlan loadPlan;
+    // row groups read/skipped by the last columnar load
+    ColumnarScan columnarScan;
+    bool columnarInput = false;
+    // where the last single-file load stopped, for live tail (menu 12)
+    TailPosition tailPosition;
+    // The loaded bids, as immutable versions: loads, sorts and appends build
+    // the next version in the background and swap it in, so anything still
+    // reading the old one is never stalled or disturbed
+    BidStore store;
     // Timer variables: using steady_clock for precise wall-clock measurement instead of CPU ticks
     std::chrono::steady_clock::time_point start, end;
     //Variable to hold the duration in microseconds
     std::chrono::duration<double> duration;
 
-    int choice = 0;
+    // "-" reads the CSV from stdin (extract-job | Vector_Sort -). stdin is the
+    // data rather than the menu, so the bids are sorted, written to stdout
+    // in batches and the program exits
+    bool pipeline = inputPaths.size() == 1 && csvPath == "-";
+    int status = 0;
+    if (pipeline) {
+        try {
+            vector<Bid> parsed = parseBids(csvPath, readOptions);
+            if (!parsed.empty()) {
+                vsort::OrderSample sample;
+                autoSort(parsed, partitionStrategy, normalizedKeys, sample);
+            }
+            BidList bids;
+            bids.assign(std::move(parsed));
+            if (!writeBids(STDOUT_FILENO, bids, 0, bids.size())) {
+                status = 1;
+            }
+        } catch (csv::Error &e) {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    int choice = pipeline ? 9 : 0;
     while (choice != 9) {
+        // the version this menu pass reads (held, so bids stays valid), and
+        // the one an update below publishes
+        BidStore::Snapshot snapshot = store.current();
+        BidStore::Snapshot published;
+        const BidList &bids = snapshot->bids;
+        // whether the sort below could afford normalized keys
+        bool keysUsed = normalizedKeys;
+
         // DASHBOARD HEADER
         std::cout << "\x1b[2J\x1b[H"; // clear screen + home cursor
 
@@ -373,8 +478,14 @@ int main(int argc, char *argv[]) {
         // Border Box and ANSII colors
         std::cout
                 << CY << "┌──────────────────────── Vector Sorting Dashboard ────────────────────────┐\n" << R
-                << CY << "│ " << R << "Loaded bids: " << GR << bids.size() << R << "\n" // shows how many bids are loaded
-                << CY << "│ " << R << "CSV: " << YL << csvPath << R << "\n"            // shows the CSV file in use
+                << CY << "│ " << R << "Loaded bids: " << GR << bids.size() << R // shows how many bids are loaded
+                << " (version " << snapshot->version << ") | Memory: " << mem::formatBytes(mem::total())
+                << (mem::budget() ? " of " + mem::formatBytes(mem::budget()) : string()) << "\n"
+                << CY << "│ " << R << "CSV: " << YL << csvPath << R;            // shows the CSV file in use
+        if (inputPaths.size() > 1) {
+            std::cout << " (+" << inputPaths.size() - 1 << " more)";
+        }
+        std::cout << "\n"
                 << CY << "└──────────────────────────────────────────────────────────────────────────┘\n" << R;
 
         // Menu box top
@@ -389,7 +500,13 @@ int main(int argc, char *argv[]) {
         cout << "  5. Why Quick Sort Is Faster (T(n))" << endl; // Information on Big-O for education
         cout << "  6. View Flowcharts (Selection vs Quick)" << endl; // simple visual steps for both
         cout << "  7. Add a Bid Manually" << endl; // Add a bid to the in-memory list and append to CSV
+        cout << "  8. Instrumentation Report" << endl; // phase timings, counters and memory since start
         cout << "  9. Exit" << endl;
+        cout << " 10. Toggle Quick Sort Partition (now: " << vsort::partitionName(partitionStrategy) << ")" << endl;
+        cout << " 11. Toggle Sort Keys (now: " << (normalizedKeys ? "normalized" : "plain") << ")" << endl;
+        cout << " 12. Live Tail (ingest rows appended to the CSV)" << endl;
+        cout << " 13. Export Columnar (.vsc)" << endl;
+        cout << " 14. Auto Sort (sample order: adaptive run merge or quick sort)" << endl;
         // Dashboard Menu Bottom Border
         std::cout << CY
                 << "└──────────────────────────────────────────────────────────────────────────┘\n" << R;
@@ -398,7 +515,10 @@ int main(int argc, char *argv[]) {
         //Prompts a choice in YL(yellow), reads choice, STD flush to ensure prompt shows before input
         std::cout << YL << "➤ " << R << "Enter choice: " << GR << std::flush;
         std::string choiceLine;
-        std::getline(cin, choiceLine);
+        if (!std::getline(cin, choiceLine)) {
+            // stdin closed (e.g. scripted input ran out): exit instead of spinning on the menu
+            choiceLine = "9";
+        }
         std::cout << R; // resets color
 
         // trim whitespace
@@ -429,10 +549,41 @@ int main(int argc, char *argv[]) {
 
         switch (choice) {
             case 1:
+                // a pipe can't be rewound: loading it again would come back empty
+                if (inputDrained) {
+                    cout << "**ERROR: The input was streamed (stdin or a pipe) and has already been read;"
+                         << " restart to load it again.**" << endl;
+                    pauseForUser();
+                    break;
+                }
                 // Start time with steady_clcck::now(); for start time
                 start = std::chrono::steady_clock::now();
-            // Load the bids
-                bids = loadBids(csvPath);
+            // Load the bids into a fresh version; the current one stays readable until it is swapped out
+                loadPlan = LoadPlan();
+                // a load that fails must not leave the previous file's offset behind
+                tailPosition = TailPosition();
+                published = store.rebuild([&](BidSnapshot &next) {
+                    if (multiFile) {
+                        cout << "Loading " << inputPaths.size() << " CSV files" << endl;
+                        next.bids.assign(loadBidFiles(inputPaths, duplicatePolicy, loadThreads, readOptions, &loadStats));
+                        for (const string &error: loadStats.errors) {
+                            std::cerr << error << std::endl;
+                        }
+                    } else if (isColumnarFile(csvPath)) {
+                        // mmap the exported columns; its recorded sort order carries over
+                        cout << "Loading columnar file " << csvPath << endl;
+                        columnarInput = true;
+                        try {
+                            next.bids.assign(readColumnar(csvPath, columnarFilter, &columnarScan));
+                        } catch (csv::Error &e) {
+                            std::cerr << e.what() << std::endl;
+                        }
+                        next.sortedByTitle = columnarScan.order == eORDER_TITLE;
+                    } else {
+                        next.bids.assign(loadBids(csvPath, readOptions, &tailPosition, &loadPlan));
+                    }
+                }).get();
+                inputDrained = streamedInput;
             //Capture the end time using stead_clock::now(); for end time
                 end = std::chrono::steady_clock::now(); // Records the time after loading bids using stead_clock::now()
             // Calculate elapsed time and
@@ -443,7 +594,7 @@ int main(int argc, char *argv[]) {
             // BORDER (case 1)
                 std::cout
                         << "\n" << CY << "┌────────────────────── Load Bids ──────────────────────┐\n" << R
-                        << CY << "│ " << R << "Bids processed: " << GR << bids.size() << R << "\n"
+                        << CY << "│ " << R << "Bids processed: " << GR << published->bids.size() << R << "\n"
                         // Shows bids processed in green
                         << CY << "│ " << R << "Time: " << YL // yellow for time
                         << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
@@ -452,7 +603,37 @@ int main(int argc, char *argv[]) {
                         << CY << "│ " << R << "Seconds: " << YL //
                         << std::fixed << std::setprecision(3) << duration.count()
                         //set precision to 3 decimal places for better readablity
-                        << " s" << R << "\n"
+                        << " s" << R << "\n";
+                if (multiFile) {
+                    // wall time tracks the slowest file; the sum is what a serial load would have taken
+                    std::cout
+                            << CY << "│ " << R << "Files: " << GR << loadStats.files << R
+                            << " on " << loadStats.threads << " thread(s)"
+                            << " | Duplicates dropped: " << GR << loadStats.duplicates << R
+                            << " (keep " << (duplicatePolicy == eKEEP_FIRST ? "first" : "last") << ")\n"
+                            << CY << "│ " << R << "Slowest file: " << YL << std::setprecision(3)
+                            << loadStats.slowestFileSeconds << " s" << R
+                            << " | Sum of files: " << YL << loadStats.totalFileSeconds << " s" << R << "\n";
+                }
+                // what is held now, and the high-water mark (menu 8 has the breakdown of peaks)
+                std::cout
+                        << CY << "│ " << R << "Memory: " << GR << mem::usage() << R
+                        << " | peak " << YL << mem::formatBytes(mem::peakTotal()) << R << "\n";
+                if (!published->bids.empty() && (multiFile ? loadStats.streamed : loadPlan.streamed)) {
+                    std::cout << CY << "│ " << R << "Rows streamed into bids to stay under the "
+                              << mem::formatBytes(mem::budget()) << " budget";
+                    if (!multiFile && loadPlan.known) {
+                        std::cout << " (parsing first: ~" << mem::formatBytes(loadPlan.rowBytes + loadPlan.bidBytes) << ")";
+                    }
+                    std::cout << "\n";
+                }
+                if (columnarInput) {
+                    std::cout
+                            << CY << "│ " << R << "Row groups: " << GR << columnarScan.groups - columnarScan.groupsSkipped
+                            << R << " read, " << GR << columnarScan.groupsSkipped << R << " skipped by min/max"
+                            << " | Order: " << (columnarScan.order == eORDER_TITLE ? "title" : "none") << "\n";
+                }
+                std::cout
                         << CY << "│ " << R << "You may now sort (3 = selection, 4 = quick sort)" << "\n"
                         //User instruction for selection or quick sort
                         << CY << "└───────────────────────────────────────────────────────┘" << R << "\n";
@@ -465,10 +646,8 @@ int main(int argc, char *argv[]) {
 
 
             case 2:
-                // const auto is modern C++11 way ato avoid copying each bid
-                for (const auto &bid: bids) {
-                    displayBid(bid);
-                }
+                // one write per large batch (or a pager on a terminal), not a stream insert per field
+                showBids(bids);
                 cout << endl;
                 pauseForUser();
                 break;
@@ -482,18 +661,34 @@ int main(int argc, char *argv[]) {
                     break;
                 }
 
-            // start timing selection sort
-                start = std::chrono::steady_clock::now();
-            // perform selection sort
-                selectionSort(bids);
-            // stop timing
-                end = std::chrono::steady_clock::now();
+            // sort a copy in the background; the timing covers the sort alone
+                try {
+                    published = store.modify([&](BidSnapshot &next) {
+                        next.bids.rewrite([&](vector<Bid> &sorted) {
+                        // start timing selection sort
+                            start = std::chrono::steady_clock::now();
+                        // perform selection sort
+                            keysUsed = keysFit(normalizedKeys, sorted.size());
+                            selectionSort(sorted, keysUsed);
+                        // stop timing
+                            end = std::chrono::steady_clock::now();
+                        });
+                        next.sortedByTitle = true;
+                    }).get();
+                } catch (csv::Error &e) {
+                    // the copy to sort would not fit the memory budget
+                    std::cerr << e.what() << std::endl;
+                    pauseForUser();
+                    break;
+                }
             // compute elapsed duration
                 duration = end - start;
             // bordered summary for selection sort
                 std::cout
                         << "\n" << CY << "┌──────────────────── Selection Sort ────────────────────┐\n" << R
-                        << CY << "│ " << R << "Bids sorted: " << GR << bids.size() << R << "\n"
+                        << CY << "│ " << R << "Bids sorted: " << GR << published->bids.size() << R << "\n"
+                        << CY << "│ " << R << "Keys: " << GR << (keysUsed ? "normalized" : "plain") << R
+                        << (keysUsed != normalizedKeys ? " (key scratch over the memory budget)" : "") << "\n"
                         << CY << "│ " << R << "Time: " << YL
                         << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
                         << " microseconds" << R << "\n"
@@ -515,19 +710,35 @@ int main(int argc, char *argv[]) {
                     cout << "**ERROR: No bids loaded. Please press 1 to load bids first.**" << endl;
                     break;
                 }
-            //Capture start time for quicksort
-                start = std::chrono::steady_clock::now();
-            //Invoke quicksort with bids vector, 0, and size -1
-                quickSort(bids, 0, bids.size() - 1);
-            //Capture end time for quicksort
-                end = std::chrono::steady_clock::now();
+                try {
+                    published = store.modify([&](BidSnapshot &next) {
+                        next.bids.rewrite([&](vector<Bid> &sorted) {
+                        //Capture start time for quicksort
+                            start = std::chrono::steady_clock::now();
+                        //Invoke quicksort with bids vector, 0, and size -1
+                            keysUsed = keysFit(normalizedKeys, sorted.size());
+                            quickSort(sorted, 0, sorted.size() - 1, partitionStrategy, keysUsed);
+                        //Capture end time for quicksort
+                            end = std::chrono::steady_clock::now();
+                        });
+                        next.sortedByTitle = true;
+                    }).get();
+                } catch (csv::Error &e) {
+                    // the copy to sort would not fit the memory budget
+                    std::cerr << e.what() << std::endl;
+                    pauseForUser();
+                    break;
+                }
             //Compute duration
                 duration = end - start;
 
             // bordered summary around quick sort for better UI, formatting, and readability
                 std::cout
                         << "\n" << CY << "┌───────────────────── Quick Sort ──────────────────────┐\n" << R
-                        << CY << "│ " << R << "Bids sorted: " << GR << bids.size() << R << "\n"
+                        << CY << "│ " << R << "Bids sorted: " << GR << published->bids.size() << R << "\n"
+                        << CY << "│ " << R << "Partition: " << GR << vsort::partitionName(partitionStrategy) << R
+                        << " | Keys: " << GR << (keysUsed ? "normalized" : "plain") << R
+                        << (keysUsed != normalizedKeys ? " (key scratch over the memory budget)" : "") << "\n"
                         // print bids sorted to console
                         << CY << "│ " << R << "Time: " << YL // yellow for time
                         << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
@@ -630,30 +841,257 @@ int main(int argc, char *argv[]) {
                 // Get a new bid from the user. getBid() handles strings + amount parsing.
                 Bid newBid = getBid(); // collect fields
 
-                // Add it to in-memory list
-                bids.push_back(newBid);
-
-                // Try to persist the new bid so it survives reloads and restarts
-                bool saved = appendBidToCsv(newBid, csvPath);
+                // Add it to in-memory list (in title order if the list is sorted);
+                // the writer merges it while the row is appended to the CSV below
+                std::future<BidStore::Snapshot> adding = store.modify([&](BidSnapshot &next) {
+                    vector<Bid> added(1, newBid);
+                    mergeBids(next.bids, added, next.sortedByTitle, partitionStrategy, normalizedKeys);
+                });
+
+                // Try to persist the new bid so it survives reloads and restarts. Only
+                // a single plain CSV that was loaded as such (tailPosition.valid) can
+                // take an appended row: a .vsc export, a .gz/.zst file or a set of
+                // files would be corrupted by it (or pick the wrong file), and opening
+                // a FIFO or "-" for writing would hang or create a file, so they are left alone
+                bool persistable = !multiFile && !columnarInput && !streamedInput && tailPosition.valid;
+                long long sizeBefore = fileSize(csvPath);
+                bool saved = persistable && appendBidToCsv(newBid, csvPath);
+                // already in memory: step the tail past our own row so it isn't ingested twice
+                if (saved && tailPosition.valid && sizeBefore == static_cast<long long>(tailPosition.offset)) {
+                    tailPosition.offset = static_cast<size_t>(fileSize(csvPath));
+                    tailPosition.unterminated = false; // our row starts with the missing '\n'
+                }
+                published = adding.get();
 
                 // Show a confirmation box with same border width
                 std::cout
                         << "\n" << CY << "┌────────────────────────── Add Bid ──────────────────────────┐\n" << R
                         << CY << "│ " << R << (saved
                                                    ? "New bid added and saved to CSV."
-                                                   : "New bid added (could not save to CSV).") << "\n"
-                        << CY << "│ " << R << "Total bids in memory: " << GR << bids.size() << R << "\n"
+                                                   : persistable
+                                                         ? "New bid added (could not save to CSV)."
+                                                         : "New bid added, not saved (the input is not a single plain CSV file).")
+                        << "\n"
+                        << CY << "│ " << R << "Total bids in memory: " << GR << published->bids.size() << R << "\n"
                         << CY << "│ " << R << "Bid: " << YL << newBid.bidId << R << ": " << newBid.title << " | $" <<
                         fixed << setprecision(2) << newBid.amount << " | " << newBid.fund << "\n"
                         << CY << "└──────────────────────────────────────────────────────────────┘" << R << "\n";
                 pauseForUser();
                 break;
             }
+            // New case 8: where the time (and memory) went (I/O vs tokenize vs sort ...)
+            case 8:
+                std::cout << "\n" << CY << "┌──────────────────────────────────────────────────────────────────────────┐\n" << R
+                        << CY << "│ " << YL << "Instrumentation Report (cumulative)" << R << "\n"
+                        << CY << "└──────────────────────────────────────────────────────────────────────────┘" << R << "\n";
+                instr::printReport(std::cout);
+                // what each subsystem holds now and at its high-water mark
+                std::cout << "\n";
+                mem::printReport(std::cout);
+                pauseForUser();
+                break;
+
+            // New case 10: switch between the classic Hoare loop and the block partition
+            case 10:
+                partitionStrategy = partitionStrategy == vsort::eBLOCK ? vsort::eHOARE : vsort::eBLOCK;
+                cout << "Quick sort will use the " << vsort::partitionName(partitionStrategy)
+                        << " partition." << endl;
+                pauseForUser();
+                break;
+
+            // New case 11: compare full title strings or normalized 16-byte key prefixes
+            case 11:
+                normalizedKeys = !normalizedKeys;
+                cout << "Sorts will compare " << (normalizedKeys ? "normalized 16-byte key prefixes" : "full title strings")
+                        << "." << endl;
+                pauseForUser();
+                break;
+
+            // New case 12: follow the CSV and parse only what gets appended to it
+            case 12: {
+                if (multiFile || !tailPosition.valid) {
+                    cout << "**ERROR: Live tail follows one uncompressed CSV. Load it with 1 first"
+                            << (multiFile ? " (start with a single file)." : ".") << "**" << endl;
+                    pauseForUser();
+                    break;
+                }
+                FileWatch watch(csvPath);
+                std::cout
+                        << "\n" << CY << "┌────────────────────── Live Tail ──────────────────────┐\n" << R
+                        << CY << "│ " << R << "Watching: " << YL << csvPath << R
+                        << " (" << (watch.native() ? "inotify" : "polling") << ")\n"
+                        << CY << "│ " << R << "From byte: " << GR << tailPosition.offset << R
+                        << (snapshot->sortedByTitle ? " | merging in title order" : "") << "\n"
+                        << CY << "│ " << R << "Press Enter to stop" << "\n"
+                        << CY << "└───────────────────────────────────────────────────────┘" << R << "\n" << std::flush;
+
+                size_t tailed = 0;
+                size_t loaded = bids.size();
+                // the writer merges each batch while the tail goes back to
+                // waiting; batches apply in order, so only the last is awaited
+                std::future<BidStore::Snapshot> merging;
+                while (true) {
+                    // parse what was appended since the last look (also catches
+                    // anything written between the load and now)
+                    vector<Bid> batch;
+                    try {
+                        start = std::chrono::steady_clock::now();
+                        batch = tailBids(csvPath, tailPosition);
+                        if (!batch.empty()) {
+                            string lines;
+                            for (const auto &bid: batch) {
+                                lines.append(GR).append("+ ").append(R);
+                                formatBid(lines, bid);
+                            }
+                            cout << lines;
+                            size_t added = batch.size();
+                            auto pending = make_shared<vector<Bid> >(std::move(batch));
+                            vsort::PartitionStrategy strategy = partitionStrategy;
+                            bool keys = normalizedKeys;
+                            merging = store.modify([pending, strategy, keys](BidSnapshot &next) {
+                                mergeBids(next.bids, *pending, next.sortedByTitle, strategy, keys);
+                            });
+                            end = std::chrono::steady_clock::now();
+                            duration = end - start;
+                            tailed += added;
+                            cout << CY << "│ " << R << "+" << GR << added << R << " bid(s) in " << YL
+                                    << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
+                                    << " microseconds" << R << " | loaded: " << loaded + tailed
+                                    << " | offset: " << tailPosition.offset << "\n" << std::flush;
+                        }
+                    } catch (csv::Error &e) {
+                        // truncated/replaced file or a malformed row: a full reload is needed
+                        std::cerr << e.what() << " (press 1 to reload)" << std::endl;
+                        break;
+                    }
+
+                    int events = watch.wait(-1, STDIN_FILENO);
+                    if (events & eWATCH_INPUT) {
+                        std::string stopLine;
+                        std::getline(cin, stopLine);
+                        break;
+                    }
+                }
+                if (merging.valid()) {
+                    try {
+                        published = merging.get();
+                    } catch (exception &e) {
+                        std::cerr << e.what() << std::endl;
+                    }
+                }
+                cout << "Live tail stopped: " << tailed << " bid(s) ingested, " << store.current()->bids.size() << " loaded."
+                        << endl;
+                pauseForUser();
+                break;
+            }
+
+            // New case 13: persist the current (usually sorted) bids as mmap-able columns
+            case 13: {
+                if (bids.empty()) {
+                    cout << "**ERROR: No bids loaded. Please press 1 to load bids first.**" << endl;
+                    pauseForUser();
+                    break;
+                }
+                string exportPath = columnarPathFor(csvPath);
+                cout << "Export to [" << exportPath << "]: " << std::flush;
+                string pathLine;
+                std::getline(cin, pathLine);
+                ltrim(pathLine); rtrim(pathLine);
+                if (!pathLine.empty()) {
+                    exportPath = pathLine;
+                }
+
+                start = std::chrono::steady_clock::now();
+                try {
+                    writeColumnar(exportPath, bids, snapshot->sortedByTitle ? eORDER_TITLE : eORDER_NONE);
+                } catch (csv::Error &e) {
+                    std::cerr << e.what() << std::endl;
+                    pauseForUser();
+                    break;
+                }
+                end = std::chrono::steady_clock::now();
+                duration = end - start;
+
+                std::cout
+                        << "\n" << CY << "┌─────────────────── Export Columnar ───────────────────┐\n" << R
+                        << CY << "│ " << R << "File: " << YL << exportPath << R << " (" << fileSize(exportPath)
+                        << " bytes)\n"
+                        << CY << "│ " << R << "Bids written: " << GR << bids.size() << R
+                        << " | Order: " << (snapshot->sortedByTitle ? "title" : "none") << "\n"
+                        << CY << "│ " << R << "Time: " << YL
+                        << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
+                        << " microseconds" << R << "\n"
+                        << CY << "│ " << R << "Load it back with: Vector_Sort " << exportPath << "\n"
+                        << CY << "└───────────────────────────────────────────────────────┘" << R << "\n";
+                pauseForUser();
+                break;
+            }
+
+            // New case 14: let the sampled input order pick the engine
+            case 14: {
+                if (bids.empty()) {
+                    cout << "**ERROR: No bids loaded. Please press 1 to load bids first.**" << endl;
+                    pauseForUser();
+                    break;
+                }
+                vsort::OrderSample sample;
+                const char *engine = NULL;
+                try {
+                    published = store.modify([&](BidSnapshot &next) {
+                        next.bids.rewrite([&](vector<Bid> &sorted) {
+                            start = std::chrono::steady_clock::now();
+                            keysUsed = keysFit(normalizedKeys, sorted.size());
+                            engine = autoSort(sorted, partitionStrategy, keysUsed, sample);
+                            end = std::chrono::steady_clock::now();
+                        });
+                        next.sortedByTitle = true;
+                    }).get();
+                } catch (csv::Error &e) {
+                    // the copy to sort would not fit the memory budget
+                    std::cerr << e.what() << std::endl;
+                    pauseForUser();
+                    break;
+                }
+                duration = end - start;
+
+                std::cout
+                        << "\n" << CY << "┌────────────────────── Auto Sort ──────────────────────┐\n" << R
+                        << CY << "│ " << R << "Bids sorted: " << GR << published->bids.size() << R << "\n"
+                        << CY << "│ " << R << "Sampled pairs: " << sample.pairs << " (" << sample.ascending
+                        << " ascending, " << sample.descending << " descending)\n"
+                        << CY << "│ " << R << "Engine: " << GR << engine << R << " | Keys: " << GR
+                        << (engine == string("quick") && keysUsed ? "normalized" : "plain") << R << "\n"
+                        << CY << "│ " << R << "Time: " << YL
+                        << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
+                        << " microseconds" << R << "\n"
+                        << CY << "│ " << R << "Seconds: " << YL
+                        << std::fixed << std::setprecision(3) << duration.count()
+                        << " s" << R << "\n"
+                        << CY << "└───────────────────────────────────────────────────────┘" << R << "\n";
+                pauseForUser();
+                break;
+            }
+
             default: ; // default switch, do nothing for now
         }
     }
 
-    cout << "Good bye." << endl;
+    // Dump the profile on the way out if it was requested on the command line
+    if (!profileJsonPath.empty()) {
+        std::ofstream json(profileJsonPath);
+        if (json.is_open()) {
+            instr::writeJson(json);
+        } else {
+            std::cerr << "Could not write profile to " << profileJsonPath << std::endl;
+        }
+    }
+    if (!tracePath.empty() && !instr::writeTrace(tracePath)) {
+        std::cerr << "Could not write trace to " << tracePath << std::endl;
+    }
+
+    if (!pipeline) {
+        cout << "Good bye." << endl;
+    }
 
-    return 0;
+    return status;
 }